@@ -1,33 +1,77 @@
+#include <vector>
+
 constexpr int TICK_ERR = -1;
 constexpr int TICK_HLT = -2;
 constexpr int TICK_BUS = -3;
+// Stopped on a breakpoint/watchpoint (see Mix::set_break)
+constexpr int TICK_BRK = -4;
 
 class MixIO;
 class MixCPU;
 
+/*
+ * Drives the CPUs and the I/O coprocessor. On each tick the CPUs run
+ * in the order they were added (so a multiprocessor is deterministic,
+ * see multi.h), then the I/O coprocessor.
+ * With several CPUs, one that halts sits out the following ticks,
+ * and tick_at only returns TICK_HLT once all of them have halted
+ * (they stay halted until resume()).
+ */
 class MixClock {
 public:
-  MixClock(MixCPU *cpu, MixIO *io) : cpu(cpu), io(io) {};
+  MixClock(MixCPU *cpu, MixIO *io) : cpus {cpu}, halted {false}, io(io) {};
+  void add_cpu(MixCPU *cpu) {
+    cpus.push_back(cpu);
+    halted.push_back(false);
+  }
   int ts() { return _ts; }
+  // Move the clock without ticking (for snapshots)
+  void set_ts(int ts) { _ts = ts; }
   int tick() {
     return tick_at(_ts + 1);
   }
   int tick_at(int new_ts) {
     _ts = new_ts;
     int ret;
-    if ((ret = cpu->tick()) < 0)
-      return ret;
+    for (size_t k = 0; k < cpus.size(); k++) {
+      if (halted[k])
+        continue;
+      if ((ret = cpus[k]->tick()) == TICK_HLT && cpus.size() > 1) {
+        halted[k] = true;
+        if (++num_halted < cpus.size())
+          continue;
+      }
+      if (ret < 0)
+        return ret;
+    }
     if ((ret = io->tick()) < 0)
       return ret;
     return _ts;
   }
+  bool is_halted(int k) { return halted[k]; }
+  bool all_halted() { return num_halted == cpus.size(); }
+  // Let every halted CPU run again
+  void resume() {
+    halted.assign(cpus.size(), false);
+    num_halted = 0;
+  }
+  int cpu_next_ts() {
+    return cpus[0]->next_ts();
+  }
   int next_ts() {
-    int cn = cpu->next_ts();
-    int in = io->next_ts();
-    return (cn < in) ? cn : in;
+    int n = io->next_ts();
+    for (size_t k = 0; k < cpus.size(); k++) {
+      if (halted[k])
+        continue;
+      int cn = cpus[k]->next_ts();
+      n = (cn < n) ? cn : n;
+    }
+    return n;
   }
 private:
-  MixCPU *cpu;
+  std::vector<MixCPU *> cpus;
+  std::vector<bool> halted;
+  size_t num_halted = 0;
   MixIO *io;
   int _ts = 0;
 };
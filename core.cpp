@@ -46,7 +46,7 @@ Byte Word::b(int i) const {
     case 5:
       return _b5;
     default:
-      D3("Bad byte! (b,w) = ", i, *this);
+      LOG_WARN(cpu, "Bad byte! (b,w) = ", i, *this);
       return -1;
   }
 }
@@ -73,7 +73,7 @@ Word Word::field(int l, int r, bool shift_left, bool shift_right) const {
 Word Word::with_field(Word src, int l, int r,
     bool default_positive, bool shift_left, bool shift_right) {
   if (l < 0 || r < 0 || l > 5 || r > 5) {
-    D3("BAD FIELD! ", l, r);
+    LOG_WARN(cpu, "BAD FIELD! ", l, r);
   }
   Sign s = default_positive ? Sign::POS : this->sgn();
   if (l == 0) {
@@ -167,3 +167,15 @@ std::ostream& operator<<(std::ostream& out, Word w) {
   return out;
 }
 
+Word& core_reg(MixCore *core, int k) {
+  return (k == 0) ? core->a :
+    (k == 1) ? core->x :
+    (k < 8) ? core->i[k-2] :
+    core->j;
+}
+
+const char *reg_name(int k) {
+  static const char *names[NUM_REGS] =
+    {"A", "X", "I1", "I2", "I3", "I4", "I5", "I6", "J"};
+  return names[k];
+}
@@ -152,3 +152,11 @@ struct MixCore {
   Word memory[MEM_SIZE];
 };
 
+/*
+ * The registers of a core by number, in the order
+ * A, X, I1-I6, J (0 to NUM_REGS-1), and their names.
+ */
+constexpr int NUM_REGS = 9;
+Word& core_reg(MixCore *core, int k);
+const char *reg_name(int k);
+
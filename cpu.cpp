@@ -1,18 +1,29 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <atomic>
+#include <cstdint>
 #include "dbg.h"
 #include "sys.h"
 #include "core.h"
 #include "io.h"
 #include "cpu.h"
 #include "clock.h"
-
-constexpr int PC_ERR = -1;
-constexpr int PC_HLT = -2;
+#include "history.h"
+#include "status.h"
+#include "profile.h"
+#include "memprof.h"
+#include "ring.h"
+#include "trace.h"
 
 MixCPU::MixCPU(MixCore *core) {
   this->core = core;
+  this->memory = core->memory;
+}
+
+MixCPU::MixCPU(MixCore *core, Word *memory) {
+  this->core = core;
+  this->memory = memory;
 }
 
 void MixCPU::init(MixClock *clock, MixIO *io) {
@@ -49,33 +60,18 @@ bool cmpop(int c) {
   return (c >= 56);
 }
 
-int MixCPU::execute(Word w) {
-  Word aa = w.field(0, 2);
-  int i = w.b(3);
-  int f = w.b(4);
-  int c = w.b(5);
+int MixCPU::decode(Word w, MixInst& in) {
+  in.w = w;
+  in.aa = w.field(0, 2);
+  in.i = w.b(3);
+  in.f = w.b(4);
+  in.c = w.b(5);
+  int i = in.i;
+  int f = in.f;
+  int c = in.c;
   // validate i
   if (i < 0 || i > 6) {
-    D3("invalid i, (i,w) = ", i, w);
-    return PC_ERR;
-  }
-
-  Word m = aa;
-  if (i > 0) {
-    m = m + core->i[i-1];
-  }
-  // Note: if m == 0, m has same sign as aa
-
-  // validate m
-  if (
-      // All arithmetic, memory, jump, cmp, and MOVE
-      // ops require M to be a valid memory address
-      ((arithop(c) || memop(c) || jmpop(c) ||
-        cmpop(c) || (c == 7)) &&
-       (m < 0 || m >= MEM_SIZE)) ||
-      // Shift op requires non negative m
-      (c == 6 && m < 0)) {
-    D3("Invalid m, (m,w) = ", m, w);
+    LOG_WARN(cpu, "invalid i, (i,w) = ", i, w);
     return PC_ERR;
   }
 
@@ -90,8 +86,9 @@ int MixCPU::execute(Word w) {
       // ie, 0 <= L <= R <= 5
       ((arithop(c) || memop(c) || cmpop(c)) &&
        (l > r || r > 5)) ||
-      // Special ops require F = 0 (NUM), 1 (CHAR), or 2 (HLT)
-      (c == 5 && f > 2) ||
+      // Special ops require F = 0 (NUM), 1 (CHAR), 2 (HLT) or
+      // 3 (XCHA)
+      (c == 5 && f > 3) ||
       // Shift ops require F in [0,5]
       (c == 6 && f > 6) ||
       // (IO ops validated by IO coprocessor)
@@ -101,22 +98,89 @@ int MixCPU::execute(Word w) {
       ((jmpop(c) && c != 34 && c != 38 && c != 39) && f > 6) ||
       // Transfer ops require F in [0,3]
       (transop(c) && f > 3)) {
-    D3("invalid field, (f,w) = ", f, w);
+    LOG_WARN(cpu, "invalid field, (f,w) = ", f, w);
+    return PC_ERR;
+  }
+  in.l = l;
+  in.r = r;
+  return 0;
+}
+
+int MixCPU::execute(Word w) {
+  MixInst in;
+  if (decode(w, in) < 0)
+    return PC_ERR;
+  return apply(in);
+}
+
+int MixCPU::apply(const MixInst& in) {
+  Word w = in.w;
+  int i = in.i;
+  int f = in.f;
+  int c = in.c;
+  int l = in.l;
+  int r = in.r;
+
+  Word m = in.aa;
+  if (i > 0) {
+    m = m + core->i[i-1];
+  }
+  // Note: if m == 0, m has same sign as aa
+  last_addr = (m >= 0 && m < MEM_SIZE) ? (int) m : -1;
+
+  // validate m
+  if (
+      // All arithmetic, memory, jump, cmp, and MOVE
+      // ops require M to be a valid memory address
+      ((arithop(c) || memop(c) || jmpop(c) ||
+        cmpop(c) || (c == 7) || (c == 5 && f == 3)) &&
+       (m < 0 || m >= MEM_SIZE)) ||
+      // Shift op requires non negative m
+      (c == 6 && m < 0)) {
+    LOG_WARN(cpu, "Invalid m, (m,w) = ", m, w);
+    return PC_ERR;
+  }
+
+  // XCHA only exists on multiprocessors
+  if (c == 5 && f == 3 && !multi) {
+    LOG_WARN(cpu, "XCHA on a single processor, w = ", w);
+    return PC_ERR;
+  }
+
+  // I/O ops need an I/O coprocessor
+  if (ioop(c) && io == nullptr) {
+    LOG_WARN(cpu, "I/O op without an I/O coprocessor, w = ", w);
     return PC_ERR;
   }
 
   // If we've made it this far, the instruction is valid.
   // Execute it.
-  D6("Executing op #C M(L:R) F = ", c, m, l, r, f);
+  LOG_TRACE(cpu, "Executing op #C M(L:R) F = ", c, m, l, r, f);
 
   Word& reg =
     (c % 8 == 0) ? core->a :
     (c % 8 == 7) ? core->x :
     core->i[(c % 8) - 1];
   Word dummy = 0; // for mem to reference if it's unused
-  Word& mem = (m >= 0 && m < MEM_SIZE) ? core->memory[m] : dummy;
+  Word& mem = (m >= 0 && m < MEM_SIZE) ? memory[m] : dummy;
 
   int next_pc = (pc + 1) % MEM_SIZE;
+  // Stores (ST*, STJ, STZ) and XCHA overwrite M
+  if ((c >= 24 && c <= 33) || (c == 5 && f == 3)) {
+    if (history != nullptr)
+      history->log_mem(m);
+    if (watch != nullptr)
+      watch->check(m);
+  }
+  if (mem_prof != nullptr) {
+    if (c == 5 && f == 3) {
+      mem_prof->read(m);
+      mem_prof->write(m);
+    } else if (c >= 24 && c <= 33)
+      mem_prof->write(m);
+    else if (arithop(c) || (c >= 8 && c < 24) || cmpop(c))
+      mem_prof->read(m);
+  }
   if (c == 0) {
     // NOP
   } else if (c == 1) {
@@ -137,7 +201,7 @@ int MixCPU::execute(Word w) {
   } else if (c == 4) {
     // DIV
     if (mem == 0) {
-      D("Divide by zero, setting overflow");
+      LOG_DEBUG(cpu, "Divide by zero, setting overflow");
       core->overflow = Overflow::ON;
     } else {
       bool neg = (core->a < 0);
@@ -188,8 +252,17 @@ int MixCPU::execute(Word w) {
         break;
       }
       case 2: // HLT
-        D("Halt!");
+        LOG_DEBUG(cpu, "Halt!");
         return PC_HLT;
+      case 3: // XCHA
+      {
+        // Exchange A with M, in one step (the synchronization
+        // primitive of multiprocessors, see multi.h)
+        Word old = mem;
+        mem = core->a;
+        core->a = old;
+        break;
+      }
     }
   } else if (c == 6) {
     // SL* vs SR* (negative vs positive index offset)
@@ -232,14 +305,22 @@ int MixCPU::execute(Word w) {
       int k0 = ((int) m) + k;
       int k1 = ((int) core->i[0]) + k;
       if (k0 < 0 || k1 < 0) {
-        D("Move command underflowed memory");
+        LOG_DEBUG(cpu, "Move command underflowed memory");
         return PC_ERR;
       }
       if (k0 >= 4000 || k1 >= 4000) {
-        D("Move command overflowed memory");
+        LOG_DEBUG(cpu, "Move command overflowed memory");
         return PC_ERR;
       }
-      core->memory[k1] = core->memory[k0];
+      if (history != nullptr)
+        history->log_mem(k1);
+      if (watch != nullptr)
+        watch->check(k1);
+      if (mem_prof != nullptr) {
+        mem_prof->read(k0);
+        mem_prof->write(k1);
+      }
+      memory[k1] = memory[k0];
     }
     core->i[0] = core->i[0] + (Word)f;
   } else if (c >= 8 && c < 16) {
@@ -259,14 +340,18 @@ int MixCPU::execute(Word w) {
     mem = mem.with_field(0, l, r);
   } else if (c == 34 || c == 38) { // I/O based jumps
     bool io_ready = (io->free_ts(f) < 0);
+    io->note_poll(f);
     if ((c == 34 && !io_ready) || // JBUS
         (c == 38 && io_ready)) { // JRED
       core->j = next_pc;
       next_pc = m;
     }
   } else if (c >= 35 && c < 38) { // I/O operations
-    D("Calling IO coprocessor for blocking I/O");
-    io->execute(w);
+    LOG_DEBUG(cpu, "Calling IO coprocessor for blocking I/O");
+    if (io->execute(w, core) < 0) {
+      LOG_DEBUG(cpu, "IO coprocessor rejected the instruction");
+      return PC_ERR;
+    }
   } else if (c == 39) {
     // Global jumps
     if (f == 1) {
@@ -327,7 +412,7 @@ int MixCPU::execute(Word w) {
   // check/validate I overflow
   for (int i = 0; i < 6; i++) {
     if (core->i[i].iov() == Overflow::ON) {
-      D3("Overflowed I register, undefined, (i,reg i)",
+      LOG_DEBUG(cpu, "Overflowed I register, undefined, (i,reg i)",
           i,
           core->i[i]);
       return PC_ERR;
@@ -336,12 +421,12 @@ int MixCPU::execute(Word w) {
 
   // check A/X overflow
   if (core->a.ov() == Overflow::ON) {
-    D("Overflowed A register");
+    LOG_DEBUG(cpu, "Overflowed A register");
     core->overflow = Overflow::ON;
     core->a = core->a.with_nov();
   }
   if (core->x.ov() == Overflow::ON) {
-    D("Overflowed X register");
+    LOG_DEBUG(cpu, "Overflowed X register");
     core->overflow = Overflow::ON;
     core->x = core->x.with_nov();
   }
@@ -350,12 +435,28 @@ int MixCPU::execute(Word w) {
 }
 
 int MixCPU::tick() {
-  if (clock->ts() < get_ts(core->memory[pc])) {
-    D("No CPU operation for this tick");
+  if (clock->ts() < get_ts(memory[pc])) {
+    LOG_TRACE(cpu, "No CPU operation for this tick");
     return 0;
   }
-  D2("Executing instruction at pc", pc);
-  int next_pc = execute(core->memory[pc]);
+  LOG_TRACE(cpu, "Executing instruction at pc", pc);
+  retired++;
+  if (status != nullptr)
+    status_hot(status, pc);
+  if (profile != nullptr) {
+    profile->count[pc]++;
+    profile->time[pc] += clock->ts() - previous_ts;
+  }
+  if (waits_for_io(memory[pc]) && clock->ts() > previous_ts + 1)
+    io->note_stall(memory[pc].b(4), clock->ts() - previous_ts - 1);
+  MixInst in;
+  last_addr = -1;
+  int next_pc = (decode(memory[pc], in) < 0) ? PC_ERR : apply(in);
+  ops[in.c]++;
+  if (tracer != nullptr)
+    trace(pc, in, next_pc);
+  if (callgraph != nullptr)
+    callgraph->step(pc, in, next_pc, clock->ts() - previous_ts);
   // set previous ts for execution
   previous_ts = clock->ts();
   // If we're halting, be sure to start up with the next
@@ -368,29 +469,69 @@ int MixCPU::tick() {
   return 0;
 }
 
+void MixCPU::trace(int at, const MixInst& in, int next_pc) {
+  int c = in.c;
+  int dest = TRACE_NONE;
+  if (next_pc == PC_ERR) {
+    // nothing changed
+  } else if ((c >= 1 && c <= 4) || c == 6 ||
+      (c == 5 && in.f != 2)) {
+    dest = 0; // A
+  } else if ((c >= 8 && c < 24) || transop(c)) {
+    // A, I1-6, X in opcode order
+    dest = (c % 8 == 0) ? 0 : (c % 8 == 7) ? 1 : c % 8 + 1;
+  } else if (c >= 24 && c <= 33) {
+    dest = TRACE_MEM;
+  } else if (jmpop(c) && next_pc != at + 1 && !(c == 39 && in.f == 1)) {
+    dest = NUM_REGS - 1; // J
+  }
+  int value = 0;
+  if (dest == TRACE_MEM)
+    value = memory[last_addr];
+  else if (dest != TRACE_NONE)
+    value = core_reg(core, dest);
+  tracer->record({clock->ts(), at, in.w, last_addr, dest, value});
+}
+
 int MixCPU::next_ts() {
-  return get_ts(core->memory[pc]);
+  int ts = get_ts(memory[pc]);
+  // Once the device an instruction waited for is free, get_ts falls
+  // back to previous_ts + 1, which is in the past by then: never move
+  // the clock backwards, run on the next tick instead
+  return (ts > clock->ts()) ? ts : clock->ts() + 1;
 }
 
-int MixCPU::get_ts(Word w) {
+bool MixCPU::waits_for_io(Word w) {
   int c = w.b(5);
-  int f = w.b(4);
-  int ts = previous_ts;
-  D5("Computing ts for word W (with C, F) given previous ts = ", w, c, f, ts);
+  return (c >= 35 && c < 38) || // blocking IO
+    (c == 34 && w.b(3) == 0 && w.field(0,2) == pc); // JBUS *
+}
+
+int op_time(int c, int f) {
   if ((c == 1 || c == 2) || // ADD, SUB
       (c == 6) || // Shift
       (c >= 8 && c < 33) || // LD*, ST*
+      (c == 5 && f == 3) || // XCHA
       (c >= 56)) { // CMP*
-    ts += 2;
+    return 2;
   } else if ((c == 3) || // MUL
       (c == 5 && (f == 0 || f == 1))) { // NUM, CHR
-    ts += 10;
+    return 10;
   } else if (c == 4) { // DIV
-    ts += 12;
+    return 12;
   } else if (c == 7) { // MOVE
-    ts += (1 + 2*f);
-  } else if ((c >= 35 && c < 38) || // blocking IO
-      (c == 34 && w.b(3) == 0 && w.field(0,2) == pc)) { // JBUS *
+    return (1 + 2*f);
+  }
+  return 1;
+}
+
+int MixCPU::get_ts(Word w) {
+  int c = w.b(5);
+  int f = w.b(4);
+  int ts = previous_ts;
+  LOG_TRACE(cpu,
+      "Computing ts for word W (with C, F) given previous ts = ", w, c, f, ts);
+  if (waits_for_io(w)) {
     // Execute after device is free
     int free_ts = io->free_ts(f);
     if (free_ts < 0) {
@@ -399,8 +540,8 @@ int MixCPU::get_ts(Word w) {
       ts = free_ts + 1;
     }
   } else {
-    ts += 1;
+    ts += op_time(c, f);
   }
-  D2("Found execution time ts", ts);
+  LOG_TRACE(cpu, "Found execution time ts", ts);
   return ts;
 }
@@ -1,10 +1,81 @@
+#include <bitset>
+#include <cstdint>
+
 struct MixCore;
 class MixClock;
+class MixHistory;
+struct MixStatus;
+struct MixProfile;
+class MixCallGraph;
+class MixMemProfile;
+class MixTracer;
+
+constexpr int PC_ERR = -1;
+constexpr int PC_HLT = -2;
+
+/*
+ * A decoded instruction: the fields of the instruction word
+ * (before indexing), with the field specification split into (L:R).
+ */
+struct MixInst {
+  Word w;
+  Word aa;
+  int i;
+  int f;
+  int c;
+  int l;
+  int r;
+};
+
+/*
+ * Memory watchpoints, checked on every store, MOVE and IN transfer
+ * while any are set. hit is the last watched address written
+ * (-1 if none since it was reset).
+ */
+struct MixWatch {
+  std::bitset<MEM_SIZE> mem;
+  int hit = -1;
+  void check(int addr) {
+    if (addr >= 0 && addr < MEM_SIZE && mem.test(addr))
+      hit = addr;
+  }
+};
+
+/*
+ * Execution time (in u) of an instruction with opcode c and field f,
+ * not counting any wait for I/O devices.
+ */
+int op_time(int c, int f);
 
 class MixCPU {
 public:
   MixCPU(MixCore *core);
+  /*
+   * A CPU with the registers of core, executing out of memory
+   * (another core's, for multiprocessors, see multi.h)
+   */
+  MixCPU(MixCore *core, Word *memory);
   void init(MixClock *clock, MixIO *io);
+  // Log memory writes (not owned)
+  void set_history(MixHistory *h) { history = h; }
+  // Check memory writes against watchpoints (not owned)
+  void set_watch(MixWatch *w) { watch = w; }
+  // Count executed instructions per address in st (not owned)
+  void set_status(MixStatus *st) { status = st; }
+  // Collect a frequency-count profile in p (not owned)
+  void set_profile(MixProfile *p) { profile = p; }
+  // Collect a call graph profile in g (not owned)
+  void set_callgraph(MixCallGraph *g) { callgraph = g; }
+  // Count memory accesses in p (not owned)
+  void set_mem_profile(MixMemProfile *p) { mem_prof = p; }
+  // Record every instruction executed in t (not owned)
+  void set_tracer(MixTracer *t) { tracer = t; }
+  // Part of a multiprocessor, which enables XCHA (see multi.h)
+  void set_multi(bool on) { multi = on; }
+  // Number of instructions executed so far
+  uint64_t get_retired() { return retired; }
+  // Number executed so far per opcode C (64 counters)
+  const uint64_t *get_ops() { return ops; }
   /*
    * Given a word, execute that word as though it's the current
    * instruction. Return the new value of the program counter.
@@ -13,6 +84,16 @@ public:
    * instruction (for debugging purposes).
    */
   int execute(Word w);
+  /*
+   * The two halves of execute():
+   * decode splits up and validates everything about the word that
+   * doesn't depend on the machine state (return PC_ERR if invalid).
+   * apply executes a decoded instruction against this CPU's core
+   * (and validates the indexed address).
+   * A decoded instruction can be applied to many CPUs.
+   */
+  static int decode(Word w, MixInst& in);
+  int apply(const MixInst& in);
   /*
    * Perform the instruction (if any) corresponding to
    * the current clock tick.
@@ -25,15 +106,38 @@ public:
   int next_ts();
 
   int get_pc() { return pc; }
+  void set_pc(int new_pc) { pc = new_pc; }
+  // ts of the previous instruction (for snapshots)
+  int get_previous_ts() { return previous_ts; }
+  void set_previous_ts(int ts) { previous_ts = ts; }
 private:
+  // registers, and the memory they execute out of
   MixCore *core;
+  Word *memory;
   MixIO *io = nullptr;
   MixClock *clock = nullptr;
+  MixHistory *history = nullptr;
+  MixWatch *watch = nullptr;
+  MixStatus *status = nullptr;
+  MixProfile *profile = nullptr;
+  MixCallGraph *callgraph = nullptr;
+  MixMemProfile *mem_prof = nullptr;
+  MixTracer *tracer = nullptr;
+  bool multi = false;
+  // M of the last instruction applied (-1 if not an address)
+  int last_addr = -1;
+  uint64_t retired = 0;
+  uint64_t ops[64] = {};
   // program counter (current instruction)
   int pc = 0;
   // ts of previous exected instruction
   // (used for timing purposes)
   int previous_ts = 0;
+  // record the instruction at address at, applied as in
+  void trace(int at, const MixInst& in, int next_pc);
+  // true if w waits for its device to be free (blocking I/O and
+  // JBUS *)
+  bool waits_for_io(Word w);
   // business logic to compute ts at which
   // instruction will complete after previous ts
   int get_ts(Word w);
@@ -1,12 +1,162 @@
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
 #include "dbg.h"
-#ifdef LOG_DEBUG
-std::ofstream *log_fs = nullptr;
 
-void log_dbg_init() {
-  log_fs = new std::ofstream("./out/debug.log");
+static const char *LEVEL_NAMES[] = {
+  "trace", "debug", "info", "warn", "error", "off"
+};
+static const char *CAT_NAMES[NUM_LOG_CATS] = {
+  "cpu", "io", "clock", "asm", "mix"
+};
+// The writer is woken early once this much is buffered
+constexpr size_t LOG_CHUNK = 1 << 16;
+
+// What is selected, checked on every record that is compiled in
+static std::atomic<bool> log_on {false};
+static std::atomic<int> log_level {LOG_LEVEL_INFO};
+static std::atomic<unsigned> log_cats {(1u << NUM_LOG_CATS) - 1};
+
+// Records waiting for the writer thread
+static std::mutex log_lock;
+static std::condition_variable log_wake;
+static std::string log_buf;
+static bool log_done = false;
+// Held while writing to the file, taken before log_lock is released
+// so chunks are written in order
+static std::mutex log_file_lock;
+static std::ofstream log_fs;
+static std::thread log_writer;
+
+// Write out what's buffered, with lk (on log_lock) held. Unlocks it.
+static void flush_buf(std::unique_lock<std::mutex>& lk) {
+  std::string out;
+  out.swap(log_buf);
+  std::lock_guard<std::mutex> file_lk {log_file_lock};
+  lk.unlock();
+  if (!out.empty()) {
+    log_fs << out;
+    log_fs.flush();
+  }
+}
+
+static void write_loop() {
+  std::unique_lock<std::mutex> lk {log_lock};
+  while (true) {
+    log_wake.wait_for(lk, std::chrono::milliseconds(100),
+        [] { return log_done || log_buf.size() >= LOG_CHUNK; });
+    bool done = log_done;
+    flush_buf(lk);
+    if (done)
+      return;
+    lk.lock();
+  }
+}
+
+void log_init(std::string filename) {
+  if (log_writer.joinable())
+    return;
+  log_fs.open(filename);
+  if (!log_fs.is_open())
+    return;
+  const char *spec = getenv("MIX_LOG");
+  if (spec != nullptr)
+    log_select(spec);
+  log_done = false;
+  log_writer = std::thread(write_loop);
+  log_on = true;
+}
+
+void log_close() {
+  if (!log_writer.joinable())
+    return;
+  log_on = false;
+  {
+    std::lock_guard<std::mutex> lk {log_lock};
+    log_done = true;
+  }
+  log_wake.notify_one();
+  log_writer.join();
+  log_fs.close();
+}
+
+int log_select(std::string spec) {
+  int level = log_level;
+  std::string cats = spec;
+  size_t colon = spec.find(':');
+  if (colon != std::string::npos) {
+    cats = spec.substr(0, colon);
+    std::string name = spec.substr(colon + 1);
+    level = -1;
+    for (int l = LOG_LEVEL_TRACE; l <= LOG_LEVEL_ERROR; l++) {
+      if (name == LEVEL_NAMES[l])
+        level = l;
+    }
+    if (level == -1)
+      return -1;
+  }
+  unsigned mask = 0;
+  std::istringstream in {cats};
+  for (std::string name; getline(in, name, ','); ) {
+    if (name == "all") {
+      mask = (1u << NUM_LOG_CATS) - 1;
+      continue;
+    } else if (name == "none") {
+      continue;
+    }
+    int c = 0;
+    while (c < NUM_LOG_CATS && name != CAT_NAMES[c])
+      c++;
+    if (c == NUM_LOG_CATS)
+      return -1;
+    mask |= 1u << c;
+  }
+  log_level = level;
+  log_cats = mask;
+  return 0;
+}
+
+std::string log_selection() {
+  std::string out;
+  for (int c = 0; c < NUM_LOG_CATS; c++) {
+    if (log_cats & (1u << c))
+      out += (out.empty() ? "" : ",") + std::string(CAT_NAMES[c]);
+  }
+  return (out.empty() ? "none" : out) + ":" + LEVEL_NAMES[log_level];
+}
+
+int log_selected_level() {
+  return log_level;
+}
+
+std::string log_level_name(int level) {
+  return LEVEL_NAMES[level];
+}
+
+bool log_enabled(int level, LogCat cat) {
+  return log_on.load(std::memory_order_relaxed) &&
+    level >= log_level.load(std::memory_order_relaxed) &&
+    (log_cats.load(std::memory_order_relaxed) & (1u << (int) cat));
 }
 
-void log_dbg_close() {
-  delete log_fs;
+void log_write(int level, const char *file, int line, std::string msg) {
+  std::ostringstream rec;
+  rec << LEVEL_NAMES[level] << " " << file << ":" << line << ": "
+    << msg << '\n';
+  std::unique_lock<std::mutex> lk {log_lock};
+  log_buf += rec.str();
+  // Warnings and errors are written right away, so they aren't lost
+  // if the process dies next
+  if (level >= LOG_LEVEL_WARN) {
+    flush_buf(lk);
+  } else if (log_buf.size() >= LOG_CHUNK) {
+    lk.unlock();
+    log_wake.notify_one();
+  }
 }
-#endif
@@ -1,39 +1,83 @@
-#include <iostream>
 #include <string>
-#include <fstream>
-#define LOG_DEBUG 0
+#include <sstream>
 
-#ifdef LOG_DEBUG
-extern std::ofstream *log_fs;
-void log_dbg_init();
-void log_dbg_close();
+/*
+ * Leveled, categorized logging.
+ *
+ * Levels below LOG_MIN_LEVEL (set at build time, eg.
+ * make CXXFLAGS+=-DLOG_MIN_LEVEL=0) compile to nothing, so the
+ * TRACE and DEBUG records in hot paths like MixCPU::execute cost
+ * nothing in a normal build. The rest are checked at runtime against
+ * the level and categories selected (see log_select), and only
+ * formatted if selected.
+ *
+ * Records are appended to a buffer, and written to the log file by a
+ * background thread, so logging doesn't wait on the file (except
+ * for warnings and errors, which are written right away).
+ *
+ * Nothing is logged until log_init() (or if it's never called).
+ */
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
 
-#define DBG_INIT() log_dbg_init()
-#define _DBG_STREAM *log_fs
-#define DBG_CLOSE() log_dbg_close()
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
 
-#else
+// cpu: execution, io: devices and I/O logs, clock: stepping the
+// machine, assembler: mixal ("asm" in specs), mix: everything else
+enum class LogCat { cpu, io, clock, assembler, mix };
+constexpr int NUM_LOG_CATS = 5;
 
-#define DBG_INIT()
-#define _DBG_STREAM std::cerr
-#define DBG_CLOSE()
+/*
+ * Start logging to filename (./out/debug.log by default), with the
+ * level and categories in the MIX_LOG environment variable, if set
+ * (see log_select), or everything at or above INFO.
+ */
+void log_init(std::string filename = "./out/debug.log");
+// Write out everything logged, and stop logging
+void log_close();
+/*
+ * Select what is logged, from a spec like "cpu,io:debug": a comma
+ * separated list of categories (or "all", or "none"), optionally
+ * followed by the minimum level (trace, debug, info, warn, error).
+ * Return -1 (and change nothing) if the spec is invalid.
+ */
+int log_select(std::string spec);
+// The current selection, as a spec
+std::string log_selection();
+// The minimum level selected, and the name of a level
+int log_selected_level();
+std::string log_level_name(int level);
 
-#endif
+bool log_enabled(int level, LogCat cat);
+void log_write(int level, const char *file, int line, std::string msg);
+
+template <typename T, typename... Rest>
+void log_format(std::ostringstream& out, const T& first,
+    const Rest&... rest) {
+  out << first;
+  ((out << ", " << rest), ...);
+}
 
-#define _DBG_WRAP(exp) ( \
-    _DBG_STREAM \
-    << __FILE__ \
-    << ":" \
-    << __LINE__ \
-    << ": " \
-    << exp \
-    << std::endl \
-)
-
-#define D(a) _DBG_WRAP(a)
-#define D2(a,b) D(a << ", " << b)
-#define D3(a,b,c) D2(a << ", " << b, c)
-#define D4(a,b,c,d) D3(a << ", " << b, c, d)
-#define D5(a,b,c,d,e) D4(a << ", " << b, c, d, e)
-#define D6(a,b,c,d,e,f) D5(a << ", " << b, c, d, e, f)
+#define LOG_AT(level, cat, ...) do { \
+  if constexpr ((level) >= LOG_MIN_LEVEL) { \
+    if (log_enabled((level), LogCat::cat)) { \
+      std::ostringstream _log_out; \
+      log_format(_log_out, __VA_ARGS__); \
+      log_write((level), __FILE__, __LINE__, _log_out.str()); \
+    } \
+  } \
+} while (0)
 
+// eg. LOG_DEBUG(io, "Staging io op #C M F = ", c, m, f);
+// (arguments are separated by ", ")
+#define LOG_TRACE(cat, ...) LOG_AT(LOG_LEVEL_TRACE, cat, __VA_ARGS__)
+#define LOG_DEBUG(cat, ...) LOG_AT(LOG_LEVEL_DEBUG, cat, __VA_ARGS__)
+#define LOG_INFO(cat, ...) LOG_AT(LOG_LEVEL_INFO, cat, __VA_ARGS__)
+#define LOG_WARN(cat, ...) LOG_AT(LOG_LEVEL_WARN, cat, __VA_ARGS__)
+#define LOG_ERROR(cat, ...) LOG_AT(LOG_LEVEL_ERROR, cat, __VA_ARGS__)
@@ -0,0 +1,147 @@
+#include <vector>
+#include <deque>
+#include <cstdint>
+#include "dbg.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "history.h"
+
+// Registers in undo entries (addr = REG_BASE - k for core_reg k)
+constexpr int REG_BASE = -1;
+
+static bool same(const Word& w1, const Word& w2) {
+  return (int) w1 == (int) w2 && w1.sgn() == w2.sgn();
+}
+
+MixHistory::MixHistory(MixCore *core, MixCPU *cpu, MixClock *clock,
+    MixIO *io, long max_steps, long snap_every)
+  : core(core), cpu(cpu), clock(clock), io(io),
+    max_steps(max_steps), snap_every(snap_every) {
+  io->save_state(io_cur);
+  io_changes = io->get_changes();
+}
+
+void MixHistory::begin() {
+  uint64_t now = step_base + steps.size();
+  if (snaps.empty() || now - snaps.back().step >= (uint64_t) snap_every)
+    take_snapshot();
+  steps.push_back({cpu->get_pc(), cpu->get_previous_ts(), clock->ts(),
+      core->overflow, core->comp, undo_base + undo.size()});
+  for (int k = 0; k < NUM_REGS; k++)
+    regs[k] = core_reg(core, k);
+}
+
+void MixHistory::commit() {
+  for (int k = 0; k < NUM_REGS; k++) {
+    if (!same(regs[k], core_reg(core, k)))
+      undo.push_back({(int16_t) (REG_BASE - k), regs[k]});
+  }
+  if (io->get_changes() != io_changes) {
+    io_states.push_back({step_base + steps.size() - 1, std::move(io_cur)});
+    io_cur.clear();
+    io->save_state(io_cur);
+    io_changes = io->get_changes();
+  }
+  trim();
+}
+
+void MixHistory::take_snapshot() {
+  snaps.emplace_back();
+  Snapshot& snap = snaps.back();
+  snap.step = step_base + steps.size();
+  snap.core = *core;
+  snap.pc = cpu->get_pc();
+  snap.previous_ts = cpu->get_previous_ts();
+  snap.ts = clock->ts();
+  snap.io_state = io_cur;
+}
+
+void MixHistory::restore_snapshot(const Snapshot& snap) {
+  *core = snap.core;
+  cpu->set_pc(snap.pc);
+  cpu->set_previous_ts(snap.previous_ts);
+  clock->set_ts(snap.ts);
+  size_t i = 0;
+  io->load_state(snap.io_state, i);
+}
+
+void MixHistory::trim() {
+  // Drop a whole snapshot interval at a time
+  while ((long) steps.size() > max_steps && snaps.size() >= 2) {
+    snaps.pop_front();
+    uint64_t base = snaps.front().step;
+    while (step_base < base) {
+      steps.pop_front();
+      step_base++;
+    }
+    uint64_t undo_keep = steps.empty() ?
+      undo_base + undo.size() : steps.front().undo_begin;
+    while (undo_base < undo_keep) {
+      undo.pop_front();
+      undo_base++;
+    }
+    while (!io_states.empty() && io_states.front().step < step_base)
+      io_states.pop_front();
+  }
+}
+
+long MixHistory::rewind(long n) {
+  uint64_t end = step_base + steps.size();
+  uint64_t target = (n >= (long) steps.size()) ? step_base : end - n;
+  LOG_INFO(mix, "Rewinding history, (from, to) = ", end, target);
+
+  // Jump to the earliest snapshot that's still at/after the target
+  uint64_t cur = end;
+  const Snapshot *jump = nullptr;
+  for (auto it = snaps.rbegin(); it != snaps.rend() && it->step >= target;
+      ++it) {
+    if (it->step < end)
+      jump = &*it;
+  }
+  if (jump != nullptr) {
+    cur = jump->step;
+    restore_snapshot(*jump);
+  }
+  while (!snaps.empty() && snaps.back().step > target)
+    snaps.pop_back();
+  // Later steps are gone along with their undo entries
+  if (cur < end) {
+    uint64_t undo_keep = steps[cur - step_base].undo_begin;
+    while (undo_base + undo.size() > undo_keep)
+      undo.pop_back();
+    while (!io_states.empty() && io_states.back().step >= cur)
+      io_states.pop_back();
+  }
+
+  // Undo one step at a time
+  while (cur > target) {
+    cur--;
+    Step& st = steps[cur - step_base];
+    while (undo_base + undo.size() > st.undo_begin) {
+      Undo& u = undo.back();
+      if (u.addr >= 0)
+        core->memory[u.addr] = u.old;
+      else
+        core_reg(core, REG_BASE - u.addr) = u.old;
+      undo.pop_back();
+    }
+    if (!io_states.empty() && io_states.back().step == cur) {
+      size_t i = 0;
+      io->load_state(io_states.back().state, i);
+      io_states.pop_back();
+    }
+    cpu->set_pc(st.pc);
+    cpu->set_previous_ts(st.previous_ts);
+    clock->set_ts(st.ts);
+    core->overflow = st.overflow;
+    core->comp = st.comp;
+  }
+  steps.resize(target - step_base);
+
+  io_cur.clear();
+  io->save_state(io_cur);
+  io_changes = io->get_changes();
+  return (long) (end - target);
+}
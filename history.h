@@ -0,0 +1,106 @@
+#include <vector>
+#include <deque>
+#include <cstdint>
+
+class MixCPU;
+class MixClock;
+class MixIO;
+
+/*
+ * Execution history, for reverse execution.
+ *
+ * Every clock event (one Mix::step) is recorded as a step: the pc,
+ * CPU/clock timestamps and flags before it, plus an undo log of the
+ * old value of every register and memory word it changed (including
+ * memory written by IN transfers). The I/O controller state is only
+ * logged for steps that changed it.
+ *
+ * On top of that, a full copy of the machine state is taken every
+ * snap_every steps. Rewinding restores the nearest such snapshot at
+ * or after the target, then undoes the remaining steps one by one,
+ * so long rewinds don't walk the whole log.
+ *
+ * At most max_steps steps are kept: the oldest ones are dropped a
+ * snapshot interval at a time, so the oldest step kept always starts
+ * at a snapshot.
+ *
+ * Device side effects are not undone: output already written stays
+ * written, and input streams don't go back.
+ */
+class MixHistory {
+public:
+  MixHistory(MixCore *core, MixCPU *cpu, MixClock *clock, MixIO *io,
+      long max_steps = 1 << 20, long snap_every = 1 << 14);
+  /*
+   * Called by Mix around each clock event.
+   */
+  void begin();
+  void commit();
+  /*
+   * Called before memory word addr is overwritten (by the CPU or
+   * the I/O coprocessor) during the current step.
+   */
+  void log_mem(int addr) {
+    if (addr >= 0 && addr < MEM_SIZE)
+      undo.push_back({(int16_t) addr, core->memory[addr]});
+  }
+  /*
+   * Rewind n steps (or as far as the history goes). The history
+   * after the new position is discarded.
+   * Return the number of steps rewound.
+   */
+  long rewind(long n);
+  // Number of steps that can be rewound
+  long size() { return (long) steps.size(); }
+private:
+  // Undo entry: addr >= 0 -> memory word, addr < 0 -> register
+  // (see REG_BASE in history.cpp)
+  struct Undo {
+    int16_t addr;
+    Word old;
+  };
+  struct Step {
+    int pc;
+    int previous_ts;
+    int ts;
+    Overflow overflow;
+    Comp comp;
+    // absolute index of its first undo entry
+    uint64_t undo_begin;
+  };
+  // I/O controller state before a step that changed it
+  struct IOState {
+    uint64_t step;
+    std::vector<char> state;
+  };
+  struct Snapshot {
+    // absolute index of the step it was taken before
+    uint64_t step;
+    MixCore core;
+    int pc;
+    int previous_ts;
+    int ts;
+    std::vector<char> io_state;
+  };
+  MixCore *core;
+  MixCPU *cpu;
+  MixClock *clock;
+  MixIO *io;
+  long max_steps;
+  long snap_every;
+  std::deque<Step> steps;
+  std::deque<Undo> undo;
+  std::deque<Snapshot> snaps;
+  std::deque<IOState> io_states;
+  // absolute index of steps[0] and undo[0]
+  uint64_t step_base = 0;
+  uint64_t undo_base = 0;
+  // registers at begin()
+  Word regs[NUM_REGS];
+  // I/O controller state as of the last change
+  std::vector<char> io_cur;
+  long io_changes = 0;
+  void take_snapshot();
+  void restore_snapshot(const Snapshot& snap);
+  void trim();
+};
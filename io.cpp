@@ -1,10 +1,21 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <string.h>
+#include <climits>
+#include <chrono>
 #include "dbg.h"
 #include "sys.h"
 #include "core.h"
 #include "io.h"
+#include "tape.h"
+#include "iolog.h"
+#include "term.h"
+#include "history.h"
+#include "memprof.h"
 #include "cpu.h"
 #include "clock.h"
 
@@ -110,8 +121,32 @@ DevInfo DEV_PAPER_TAPE = {
 };
 
 
-MixDev::MixDev(std::string filename, StorageType storage, size_t sz) {
-  D2("Initializing device file ", filename);
+MixDev::MixDev(std::string filename, StorageType storage, size_t sz,
+    DevBackend backend, size_t block_sz)
+  : filename(filename), storage(storage), sz(sz), backend(backend),
+    block_sz(block_sz) {}
+
+MixDev::MixDev(MixDev&& other)
+  : filename(std::move(other.filename)), storage(other.storage),
+    sz(other.sz), backend(other.backend), block_sz(other.block_sz),
+    fd(other.fd), tape(other.tape),
+    data(std::move(other.data)), rpos(other.rpos),
+    syscalls(other.syscalls), read_lat(other.read_lat),
+    write_lat(other.write_lat) {
+  other.fd = -1;
+  other.tape = nullptr;
+}
+
+void MixDev::open() {
+  if (backend == DevBackend::MEMORY || fd != -1 || tape != nullptr)
+    return;
+  if (backend == DevBackend::COMPRESSED) {
+    LOG_INFO(io, "Initializing compressed device file ", filename);
+    tape = new MixTape(block_sz, sz / block_sz);
+    tape->load(filename);
+    return;
+  }
+  LOG_INFO(io, "Initializing device file ", filename);
   if (storage == StorageType::FIXED_SIZE)
     fd = open_and_resize(filename, sz);
   else
@@ -121,18 +156,205 @@ MixDev::MixDev(std::string filename, StorageType storage, size_t sz) {
 MixDev::~MixDev() {
   if (fd != -1)
     close_noerr(fd);
+  if (tape != nullptr) {
+    // Write back, but never throw out of a destructor
+    try {
+      if (tape->is_dirty())
+        tape->save(filename);
+    } catch (Sys_error &e) {
+      LOG_WARN(io, "Failed to write back compressed tape ", filename, e.err);
+    }
+    delete tape;
+  }
+}
+
+void LatencyHist::add(uint64_t ns) {
+  int k = 0;
+  while (k < LAT_BUCKETS - 1 && (ns >> (k + 1)) != 0)
+    k++;
+  count[k]++;
+  n++;
+  total_ns += ns;
+}
+
+uint64_t LatencyHist::percentile(double p) const {
+  uint64_t seen = 0;
+  for (int k = 0; k < LAT_BUCKETS; k++) {
+    seen += count[k];
+    if (seen > 0 && seen >= p / 100 * n)
+      return (uint64_t) 2 << k;
+  }
+  return 0;
+}
+
+// Time a host block transfer into hist
+class LatencyTimer {
+public:
+  LatencyTimer(LatencyHist& hist)
+    : hist(hist), start(std::chrono::steady_clock::now()) {}
+  ~LatencyTimer() {
+    hist.add(std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - start).count());
+  }
+private:
+  LatencyHist& hist;
+  std::chrono::steady_clock::time_point start;
+};
+
+void MixDev::read_block(void *dest, long off, size_t sz) {
+  LatencyTimer timer(read_lat);
+  if (backend == DevBackend::FILE) {
+    // seek + read
+    syscalls += (off >= 0) ? 2 : 1;
+    (void) seek_read(fd, dest, off, sz);
+    return;
+  }
+  if (backend == DevBackend::COMPRESSED) {
+    tape->read(dest, off, sz);
+    return;
+  }
+  size_t start = (storage == StorageType::STREAM || off < 0) ?
+    rpos : (size_t) off;
+  size_t avail = (start < data.size()) ? data.size() - start : 0;
+  size_t ct = (avail < sz) ? avail : sz;
+  if (ct > 0)
+    memcpy(dest, &data[start], ct);
+  // Reads past the end of a fixed size device see zeros,
+  // reads past the end of a stream leave dest untouched
+  // (same as a short read from a file).
+  if (storage == StorageType::FIXED_SIZE)
+    zero_out((char *)dest + ct, sz - ct);
+  else
+    rpos += ct;
+}
+
+int MixDev::write_block(void *src, long off, size_t sz) {
+  // Fixed size devices don't grow (eg. a tape written past its end)
+  if (storage == StorageType::FIXED_SIZE && off >= 0 &&
+      (size_t) off + sz > this->sz) {
+    LOG_WARN(io, "Write past the end of the device, off = ", off);
+    return IO_ERR;
+  }
+  LatencyTimer timer(write_lat);
+  if (backend == DevBackend::FILE) {
+    // seek + write
+    syscalls += (off >= 0) ? 2 : 1;
+    (void) seek_write(fd, src, off, sz);
+    return 0;
+  }
+  if (backend == DevBackend::COMPRESSED) {
+    tape->write(src, off, sz);
+    return 0;
+  }
+  size_t start = (storage == StorageType::STREAM || off < 0) ?
+    data.size() : (size_t) off;
+  if (start + sz > data.size())
+    data.resize(start + sz);
+  memcpy(&data[start], src, sz);
+  return 0;
+}
+
+std::string MixDev::get_name() {
+  size_t slash = filename.find_last_of('/');
+  return (slash == std::string::npos) ?
+    filename : filename.substr(slash + 1);
+}
+
+void MixDev::get_host_stats(DevStats& s) {
+  s.syscalls = syscalls;
+  s.read_lat = read_lat;
+  s.write_lat = write_lat;
+}
+
+void MixDev::load(std::string filename) {
+  if (backend == DevBackend::COMPRESSED) {
+    open();
+    tape->load(filename);
+    return;
+  }
+  LOG_INFO(io, "Loading in-memory device from ", filename);
+  read_file(filename, data);
+  // Same as resizing the file on open
+  if (storage == StorageType::FIXED_SIZE && data.size() > sz)
+    data.resize(sz);
+  rpos = 0;
+}
+
+void MixDev::dump(std::string filename) {
+  if (backend == DevBackend::COMPRESSED) {
+    open();
+    tape->save(filename);
+    return;
+  }
+  LOG_INFO(io, "Dumping in-memory device to ", filename);
+  if (storage == StorageType::FIXED_SIZE && data.size() < sz)
+    data.resize(sz);
+  write_file(filename, data.data(), data.size());
+}
+
+void MixDev::save_state(std::vector<char>& out) {
+  if (backend == DevBackend::MEMORY) {
+    put_u64(out, rpos);
+    out.insert(out.end(), data.begin(), data.end());
+  } else if (backend == DevBackend::FILE) {
+    put_u64(out, (fd == -1) ? 0 : (uint64_t) get_offset(fd));
+  } else {
+    open();
+    tape->encode(out);
+  }
 }
 
-void MixDev::read_block(void *dest, int off, size_t sz) {
-  (void) seek_read(fd, dest, off, sz);
+DevState::~DevState() {
+  delete tape;
 }
 
-void MixDev::write_block(void *src, int off, size_t sz) {
-  (void) seek_write(fd, src, off, sz);
+int MixDev::stage_state(const std::vector<char>& in, size_t i, size_t len,
+    DevState& st) {
+  if (backend == DevBackend::MEMORY) {
+    // (empty if not saved by save_state)
+    if (len >= 8) {
+      st.rpos = get_u64(in, i);
+      st.data.assign(in.begin() + i, in.begin() + i + len - 8);
+    }
+    if (st.rpos > st.data.size())
+      st.rpos = st.data.size();
+  } else if (backend == DevBackend::FILE) {
+    size_t k = i;
+    uint64_t off = get_u64(in, k);
+    if (len < 8 || off > (uint64_t) LONG_MAX)
+      return IO_ERR;
+    st.off = (long) off;
+    // Open it now, so commit_state can't fail
+    if (st.off > 0 || fd != -1)
+      open();
+  } else {
+    std::vector<char> raw(in.begin() + i, in.begin() + i + len);
+    st.tape = new MixTape(block_sz, sz / block_sz);
+    if (st.tape->decode(raw) < 0)
+      return IO_ERR;
+  }
+  return 0;
+}
+
+void MixDev::commit_state(DevState& st) {
+  if (backend == DevBackend::MEMORY) {
+    data.swap(st.data);
+    rpos = st.rpos;
+  } else if (backend == DevBackend::FILE) {
+    if (fd != -1)
+      set_offset(fd, st.off);
+  } else {
+    // Anything written since the checkpoint is dropped, the
+    // checkpoint's image is written back instead
+    delete tape;
+    tape = st.tape;
+    st.tape = nullptr;
+  }
 }
 
 MixIO::MixIO(
     MixCore *core, // owned by caller
+    DevBackend backend,
     std::string tape_prefix,
     std::string disk_prefix,
     std::string card_punch,
@@ -142,11 +364,18 @@ MixIO::MixIO(
     std::string paper_tape
 ) {
   this->core = core;
-  D2("Initializing device files, num = ", NUM_DEVICES);
+  LOG_INFO(io,
+      "Initializing devices (opened on first use), num = ", NUM_DEVICES);
+  // MixDev owns a file descriptor, so never let the vector
+  // reallocate (and copy) it.
+  dev.reserve(NUM_DEVICES);
+  dev_stats.resize(NUM_DEVICES);
   for (int i = 0; i < NUM_DEVICES; i++) {
     do_io_ts.push_back(-1);
     finish_ts.push_back(-1);
     cur_inst.push_back(0);
+    cur_regs.push_back(core);
+    handlers.emplace_back();
     pos.push_back(0);
     std::string filename;
     if (i >= 0 && i < 8) {
@@ -172,27 +401,43 @@ MixIO::MixIO(
       filename = paper_tape;
     }
 
+    // Only tapes have a compressed format
+    DevBackend dev_backend = backend;
+    if (backend == DevBackend::COMPRESSED &&
+        info[i].type != DevType::MAGNETIC_TAPE)
+      dev_backend = DevBackend::FILE;
+
     if (info[i].storage == StorageType::FIXED_SIZE) {
       dev.emplace_back(
           filename,
           StorageType::FIXED_SIZE,
-          info[i].block_size * info[i].num_blocks * sizeof(Word)
+          info[i].block_size * info[i].num_blocks * sizeof(Word),
+          dev_backend,
+          info[i].block_size * sizeof(Word)
       );
     } else {
       dev.emplace_back(
           filename,
           StorageType::STREAM,
-          0
+          0,
+          dev_backend
       );
     }
   }
 }
 
+MixIO::~MixIO() {
+  if (iolog != nullptr)
+    delete iolog;
+  if (console != nullptr)
+    delete console;
+}
+
 void MixIO::init(MixClock *clock) {
   this->clock = clock;
 }
 
-int MixIO::execute(Word w) {
+int MixIO::execute(Word w, MixCore *regs) {
   Word aa = w.field(0, 2);
   int i = w.b(3); // already validated
   int f = w.b(4);
@@ -200,17 +445,22 @@ int MixIO::execute(Word w) {
 
   // validate f
   if (f >= NUM_DEVICES) {
-    D3("Invalid f", f, w);
+    LOG_WARN(io, "Invalid f", f, w);
     return IO_ERR;
   }
 
   // validate m
   Word m = aa;
   if (i > 0) {
-    m = m + core->i[i-1];
+    m = m + regs->i[i-1];
   }
   if ((c != 35) && (m < 0 || m >= MEM_SIZE)) {
-    D3("Invalid m, (m,w) = ", m, w);
+    LOG_WARN(io, "Invalid m, (m,w) = ", m, w);
+    return IO_ERR;
+  }
+  // The whole block must fit in memory
+  if ((c == 36 || c == 37) && (int) m + info[f].block_size > MEM_SIZE) {
+    LOG_WARN(io, "Block runs past the end of memory, (m,w) = ", m, w);
     return IO_ERR;
   }
 
@@ -220,7 +470,7 @@ int MixIO::execute(Word w) {
     if (info[f].type == DevType::MAGNETIC_TAPE) {
       if (((int)m) + pos[f] < 0 ||
          ((int)m) + pos[f] >= info[f].num_blocks) {
-        D3("Invalid m for IOC:", m, w);
+        LOG_WARN(io, "Invalid m for IOC:", m, w);
         return IO_ERR;
       }
     // IOC for disk, printer, and paper tape devices
@@ -228,41 +478,50 @@ int MixIO::execute(Word w) {
         info[f].type == DevType::LINE_PRINTER ||
         info[f].type == DevType::PAPER_TAPE) {
       if (m != 0) {
-        D3("Invalid m for IOC:", m, w);
+        LOG_WARN(io, "Invalid m for IOC:", m, w);
         return IO_ERR;
       }
     // IOC not supported for other devices
     } else {
-      D3("Invalid m for IOC:", m, w);
+      LOG_WARN(io, "Invalid m for IOC:", m, w);
       return IO_ERR;
     }
   }
 
-  // validate x (for disk devices)
-  if (c <=  36 && f >= 8 && f < 16 &&
-      (core->x < 0 || core->x >= info[f].num_blocks)) {
-    D3("Invalid x for disk device", core->x, w);
+  // validate x (for disk devices: the block for IN/OUT, or where
+  // IOC seeks to)
+  if (f >= 8 && f < 16 &&
+      (regs->x < 0 || regs->x >= info[f].num_blocks)) {
+    LOG_WARN(io, "Invalid x for disk device", regs->x, w);
     return IO_ERR;
   }
 
   if (finish_ts[f] != -1) {
-    D("Executing blocked I/O instruction! Should NEVER happen!");
+    LOG_ERROR(io, "Executing blocked I/O instruction! Should NEVER happen!");
     return IO_BLK;
   }
 
-  D4("Staging io op #C M F = ", c, m, f);
+  // First use of this device (if it hasn't been opened yet)
+  dev[f].open();
+
+  LOG_TRACE(io, "Staging io op #C M F = ", c, m, f);
   // Special case: if f is a disk and is already in the right
   // place, time to execute is cut by DISK_SEEK_FACTOR
-  if (info[f].type == DevType::DISK && core->x == pos[f]) {
+  if (info[f].type == DevType::DISK && regs->x == pos[f]) {
     do_io_ts[f] = clock->ts() + (info[f].time_to_do_io/DISK_SEEK_FACTOR);
     finish_ts[f] = clock->ts() + (info[f].time_to_finish/DISK_SEEK_FACTOR);
   } else {
     do_io_ts[f] = clock->ts() + info[f].time_to_do_io;
     finish_ts[f] = clock->ts() + info[f].time_to_finish;
   }
-  D2("Io op will run at", do_io_ts[f]);
-  D2("Io device will be unblocked at", finish_ts[f]);
+  LOG_TRACE(io, "Io op will run at", do_io_ts[f]);
+  LOG_TRACE(io, "Io device will be unblocked at", finish_ts[f]);
   cur_inst[f] = w;
+  cur_regs[f] = regs;
+  changes++;
+  staged[c - 35]++;
+  dev_stats[f].ops++;
+  dev_stats[f].busy += finish_ts[f] - clock->ts();
   return 0;
 }
 
@@ -270,12 +529,30 @@ int MixIO::tick() {
   int tick_ret = 0;
   for (int d = 0; d < NUM_DEVICES; d++) {
     if (clock->ts() == do_io_ts[d]) {
-      int ret;
-      if ((ret = do_io(cur_inst[d])) < 0)
+      changes++;
+      int ret = do_io(cur_inst[d], cur_regs[d]);
+      if (ret == IO_RETRY) {
+        // Nothing to read yet. The device stays busy, and we try
+        // again one operation later.
+        LOG_DEBUG(io, "Device not ready, retrying io op later, f = ", d);
+        int wait = finish_ts[d] - do_io_ts[d];
+        // If the CPU is just waiting on the console, there is nothing
+        // else to emulate until a line arrives (see pace)
+        if (bridged && info[d].type == DevType::TERMINAL &&
+            !handlers[d].in &&
+            clock->cpu_next_ts() > clock->ts() + info[d].time_to_do_io)
+          idle_us = info[d].time_to_do_io;
+        do_io_ts[d] = clock->ts() + info[d].time_to_do_io;
+        dev_stats[d].busy += do_io_ts[d] + wait - finish_ts[d];
+        finish_ts[d] = do_io_ts[d] + wait;
+        continue;
+      }
+      if (ret < 0)
         tick_ret = ret;
       do_io_ts[d] = -1;
     }
     if (clock->ts() == finish_ts[d]) {
+      changes++;
       finish_ts[d] = -1;
       cur_inst[d] = 0;
     }
@@ -284,6 +561,13 @@ int MixIO::tick() {
 }
 
 
+int MixIO::set_handler(int f, DevHandler h) {
+  if (f < 0 || f >= NUM_DEVICES)
+    return IO_ERR;
+  handlers[f] = h;
+  return 0;
+}
+
 int MixIO::next_ts() {
   int min = WORD_MAX;
   for (auto t : do_io_ts) {
@@ -295,6 +579,118 @@ int MixIO::next_ts() {
   return min;
 }
 
+void MixIO::save_state(std::vector<char>& out) {
+  put_u32(out, NUM_DEVICES);
+  for (int f = 0; f < NUM_DEVICES; f++) {
+    put_u32(out, (uint32_t) do_io_ts[f]);
+    put_u32(out, (uint32_t) finish_ts[f]);
+    put_u32(out, (uint32_t) pos[f]);
+    const char *w = (const char *) &cur_inst[f];
+    out.insert(out.end(), w, w + sizeof(Word));
+  }
+}
+
+int MixIO::load_state(const std::vector<char>& in, size_t& i) {
+  if (get_u32(in, i) != NUM_DEVICES ||
+      i + NUM_DEVICES * (3 * 4 + sizeof(Word)) > in.size()) {
+    LOG_WARN(io, "Truncated I/O controller state");
+    return IO_ERR;
+  }
+  // The staged operations expect an open device (see execute)
+  for (int f = 0; f < NUM_DEVICES; f++) {
+    size_t k = i + f * (3 * 4 + sizeof(Word));
+    if ((int) get_u32(in, k) != -1)
+      dev[f].open();
+  }
+  for (int f = 0; f < NUM_DEVICES; f++) {
+    changes++;
+    do_io_ts[f] = (int) get_u32(in, i);
+    finish_ts[f] = (int) get_u32(in, i);
+    pos[f] = (int) get_u32(in, i);
+    memcpy(&cur_inst[f], &in[i], sizeof(Word));
+    i += sizeof(Word);
+  }
+  return 0;
+}
+
+void MixIO::save_checkpoint(std::vector<char>& out) {
+  save_state(out);
+  for (int f = 0; f < NUM_DEVICES; f++) {
+    put_u32(out, (uint32_t) dev[f].get_backend());
+    size_t len_at = out.size();
+    put_u64(out, 0);
+    dev[f].save_state(out);
+    uint64_t len = out.size() - len_at - 8;
+    memcpy(&out[len_at], &len, sizeof(len));
+  }
+  if (iolog == nullptr)
+    iolog = new MixIOLog();
+  iolog->save_state(out);
+  std::string input = (console != nullptr) ? console->get_input() : "";
+  put_u32(out, bridged);
+  put_u64(out, input.size());
+  out.insert(out.end(), input.begin(), input.end());
+}
+
+int MixIO::load_checkpoint(const std::vector<char>& in, size_t& i) {
+  // Stage everything before touching any state
+  size_t j = i;
+  if (get_u32(in, j) != NUM_DEVICES ||
+      j + NUM_DEVICES * (3 * 4 + sizeof(Word)) > in.size()) {
+    LOG_WARN(io, "Truncated I/O controller state in checkpoint");
+    return IO_ERR;
+  }
+  j += NUM_DEVICES * (3 * 4 + sizeof(Word));
+  std::vector<DevState> staged(NUM_DEVICES);
+  for (int f = 0; f < NUM_DEVICES; f++) {
+    if (j + 12 > in.size() ||
+        get_u32(in, j) != (uint32_t) dev[f].get_backend()) {
+      LOG_WARN(io, "Bad or mismatched device state in checkpoint for unit", f);
+      return IO_ERR;
+    }
+    uint64_t len = get_u64(in, j);
+    if (len > in.size() - j ||
+        dev[f].stage_state(in, j, len, staged[f]) < 0) {
+      LOG_WARN(io, "Truncated or corrupt device state in checkpoint for unit", f);
+      return IO_ERR;
+    }
+    j += len;
+  }
+  IOLogState log_state;
+  if (MixIOLog::stage_state(in, j, log_state) < 0)
+    return IO_ERR;
+  bool bridge = get_u32(in, j);
+  uint64_t input_len = get_u64(in, j);
+  if (j > in.size() || input_len > in.size() - j) {
+    LOG_WARN(io, "Truncated console state in checkpoint");
+    return IO_ERR;
+  }
+  std::string input(in.begin() + j, in.begin() + j + input_len);
+  j += input_len;
+  // The staged operations expect an open device (see execute), and
+  // COMPRESSED tapes get theirs from the checkpoint
+  for (int f = 0; f < NUM_DEVICES; f++) {
+    size_t k = i + 4 + f * (3 * 4 + sizeof(Word));
+    if ((int) get_u32(in, k) != -1 &&
+        dev[f].get_backend() != DevBackend::COMPRESSED)
+      dev[f].open();
+  }
+
+  // The log goes first: reopening it is the only step that can fail
+  // (throwing Sys_error), and it doesn't touch the machine
+  if (iolog == nullptr)
+    iolog = new MixIOLog();
+  iolog->commit_state(log_state);
+  for (int f = 0; f < NUM_DEVICES; f++)
+    dev[f].commit_state(staged[f]);
+  load_state(in, i);
+  bridge_terminal(bridge);
+  if (console != nullptr)
+    console->set_input(input);
+  i = j;
+  return 0;
+}
+
 int MixIO::free_ts(int f) {
   if (f < 0 || f >= NUM_DEVICES) {
     // invalid f, just pretend it's free to avoid weird IO block
@@ -303,6 +699,151 @@ int MixIO::free_ts(int f) {
   return finish_ts[f];
 }
 
+void MixIO::note_stall(int f, int u) {
+  if (f < 0 || f >= NUM_DEVICES)
+    return;
+  dev_stats[f].stall += u;
+  dev_stats[f].stalls++;
+}
+
+void MixIO::note_poll(int f) {
+  if (f >= 0 && f < NUM_DEVICES)
+    dev_stats[f].polls++;
+}
+
+void MixIO::get_dev_stats(int f, DevStats& s) {
+  s = dev_stats[f];
+  dev[f].get_host_stats(s);
+}
+
+// "<n> <unit>" for a latency in ns
+static std::string ns_to_str(uint64_t ns) {
+  std::ostringstream out;
+  if (ns < 10000)
+    out << ns << "ns";
+  else if (ns < 10000000)
+    out << ns / 1000 << "us";
+  else
+    out << ns / 1000000 << "ms";
+  return out.str();
+}
+
+static void hist_to_str(std::ostringstream& out, std::string name,
+    const LatencyHist& h) {
+  if (h.n == 0)
+    return;
+  out << std::endl << "  " << std::left << std::setw(6) << name
+    << std::right << " n " << h.n
+    << "  mean " << ns_to_str(h.total_ns / h.n)
+    << "  p50 <" << ns_to_str(h.percentile(50))
+    << "  p99 <" << ns_to_str(h.percentile(99)) << std::endl << "   ";
+  for (int k = 0; k < LAT_BUCKETS; k++) {
+    if (h.count[k] > 0)
+      out << " <" << ns_to_str((uint64_t) 2 << k) << ":" << h.count[k];
+  }
+}
+
+std::string MixIO::stats_to_str() {
+  std::ostringstream out;
+  int elapsed = clock->ts();
+  bool any = false;
+  for (int f = 0; f < NUM_DEVICES; f++) {
+    DevStats s;
+    get_dev_stats(f, s);
+    if (s.ops == 0 && s.polls == 0)
+      continue;
+    if (!any) {
+      out << "unit         ops     busy  util%      stall   stalls"
+        << "    polls syscalls";
+      any = true;
+    }
+    // (busy counts in-flight operations to the end)
+    double util = (elapsed > 0) ? 100.0 * s.busy / elapsed : 0;
+    out << std::endl << std::left << std::setw(6) << dev[f].get_name()
+      << std::right << std::setw(9) << s.ops << std::setw(9) << s.busy
+      << std::fixed << std::setprecision(1) << std::setw(7)
+      << (util > 100 ? 100.0 : util)
+      << std::setw(11) << s.stall << std::setw(9) << s.stalls
+      << std::setw(9) << s.polls << std::setw(9) << s.syscalls;
+    hist_to_str(out, "read", s.read_lat);
+    hist_to_str(out, "write", s.write_lat);
+  }
+  return out.str();
+}
+
+int MixIO::load_dev(int f, std::string filename) {
+  if (f < 0 || f >= NUM_DEVICES ||
+      dev[f].get_backend() == DevBackend::FILE) {
+    LOG_WARN(io, "Cannot load device from file, f = ", f);
+    return IO_ERR;
+  }
+  dev[f].load(filename);
+  return 0;
+}
+
+int MixIO::dump_dev(int f, std::string filename) {
+  if (f < 0 || f >= NUM_DEVICES ||
+      dev[f].get_backend() == DevBackend::FILE) {
+    LOG_WARN(io, "Cannot dump device to file, f = ", f);
+    return IO_ERR;
+  }
+  dev[f].dump(filename);
+  return 0;
+}
+
+int MixIO::record(std::string filename) {
+  if (iolog == nullptr)
+    iolog = new MixIOLog();
+  try {
+    iolog->record(filename);
+  } catch (Sys_error &e) {
+    LOG_WARN(io, "Failed to open I/O log for recording", filename, e.err);
+    return IO_ERR;
+  }
+  return 0;
+}
+
+int MixIO::replay(std::string filename) {
+  if (iolog == nullptr)
+    iolog = new MixIOLog();
+  try {
+    iolog->replay(filename);
+  } catch (Sys_error &e) {
+    LOG_WARN(io, "Failed to open I/O log for replay", filename, e.err);
+    return IO_ERR;
+  }
+  return 0;
+}
+
+void MixIO::stop_log() {
+  if (iolog != nullptr)
+    iolog->stop();
+}
+
+void MixIO::bridge_terminal(bool on) {
+  if (on && console == nullptr)
+    console = new MixConsole();
+  bridged = on;
+  if (!on && console != nullptr)
+    console->stop();
+}
+
+void MixIO::wait_console() {
+  int us = idle_us;
+  idle_us = 0;
+  if (bridged)
+    console->wait_input(us);
+}
+
+void MixIO::start_console() {
+  if (bridged)
+    console->start();
+}
+
+void MixIO::stop_console() {
+  if (bridged)
+    console->stop();
+}
 
 std::vector<char> CHR_TABLE = {
   ' ', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I',
@@ -372,57 +913,178 @@ std::map<char,int> CHR_REV_TABLE {
   {'\'', 55}
 };
 
+std::string words_to_line(const Word *src, int n) {
+  std::string line;
+  for (int k = 0; k < n; k++) {
+    for (int i = 1; i <= 5; i++) {
+      unsigned b = src[k].b(i);
+      line.push_back(b < CHR_TABLE.size() ? CHR_TABLE[b] : ' ');
+    }
+  }
+  // Drop trailing blanks
+  line.erase(line.find_last_not_of(' ') + 1);
+  line.push_back('\n');
+  return line;
+}
+
+void line_to_words(const std::string& line, Word *dest, int n) {
+  for (int k = 0; k < n; k++) {
+    std::vector<Byte> b(5);
+    for (int i = 0; i < 5; i++) {
+      size_t ix = 5*k + i;
+      char c = (ix < line.size()) ? toupper(line[ix]) : ' ';
+      auto it = CHR_REV_TABLE.find(c);
+      b[i] = (it != CHR_REV_TABLE.end()) ? it->second : 0;
+    }
+    dest[k] = {Sign::POS, b};
+  }
+}
+
+// Byte offset of block blocknum (of n words), or -1 (no seek) for
+// streams (blocknum -1)
+static long block_offset(int blocknum, int n) {
+  if (blocknum < 0)
+    return -1;
+  return (long) ((size_t) blocknum * n * sizeof(Word));
+}
+
+int MixIO::read_words(int f, int blocknum, Word *buf, int n) {
+  if (info[f].fmt == Format::BINARY) {
+    dev[f].read_block(
+        (void *)buf,
+        block_offset(blocknum, n),
+        n * sizeof(Word));
+  } else if (info[f].type == DevType::TERMINAL && bridged) {
+    std::string line;
+    if (!console->read_line(line))
+      return IO_RETRY;
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    line_to_words(line, buf, n);
+  } else if (info[f].fmt == Format::CHAR) {
+    // TODO
+  } else if (info[f].fmt == Format::CARD) {
+    // TODO
+  }
+  return 0;
+}
+
+int MixIO::write_words(int f, int blocknum, Word *buf, int n) {
+  if (info[f].fmt == Format::BINARY) {
+    return dev[f].write_block(
+        (void *)buf,
+        block_offset(blocknum, n),
+        n * sizeof(Word));
+  } else if (info[f].type == DevType::TERMINAL && bridged) {
+    std::string line = words_to_line(buf, n);
+    console->write(line.data(), line.size());
+  } else if (info[f].fmt == Format::CHAR) {
+    // TODO
+  } else if (info[f].fmt == Format::CARD) {
+    // TODO
+  }
+  return 0;
+}
+
 const char LINE_PRINTER_CLEAR[] =
   "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n"
   "\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n";
 
-int MixIO::do_io(Word w) {
-  // All already validated
+int MixIO::do_io(Word w, MixCore *regs) {
+  // Validated by execute (except m and x, see below)
   Word aa = w.field(0, 2);
   int i = w.b(3);
   int f = w.b(4);
   int c = w.b(5);
   Word m = aa;
   if (i > 0) {
-    m = m + core->i[i-1];
+    m = m + regs->i[i-1];
   }
-  D4("Running io op #C M F = ", c, m, f);
-  if (c == 35 || c == 36) { // IN, OUT
+  // The index register may have changed since execute checked m
+  if ((c == 36 || c == 37) &&
+      (m < 0 || (int) m + info[f].block_size > MEM_SIZE)) {
+    LOG_WARN(io, "Block runs past the end of memory, (m,w) = ", m, w);
+    return IO_ERR;
+  }
+  // So may X
+  if (f >= 8 && f < 16 &&
+      (regs->x < 0 || regs->x >= info[f].num_blocks)) {
+    LOG_WARN(io, "Invalid x for disk device", regs->x, w);
+    return IO_ERR;
+  }
+  LOG_TRACE(io, "Running io op #C M F = ", c, m, f);
+  if (c == 36 || c == 37) { // IN, OUT
     int blocknum = -1;
     if (info[f].storage == StorageType::FIXED_SIZE) {
       if (info[f].type == DevType::DISK) {
         // disks support random access
-        blocknum = core->x;
+        blocknum = regs->x;
       } else {
         blocknum = pos[f];
       }
-      pos[f] += 1; // block number will be incremented after read/write
     }
-    if (info[f].fmt == Format::BINARY) {
-      if (c == 35) { // IN, binary
-        dev[f].read_block(
-            (void *)&core->memory[m],
-            blocknum * info[f].block_size * sizeof(Word),
-            info[f].block_size * sizeof(Word));
-      } else { // OUT, binary
-        dev[f].write_block(
-            (void *)&core->memory[m],
-            blocknum * info[f].block_size * sizeof(Word),
-            info[f].block_size * sizeof(Word));
+    Word *buf = &core->memory[m];
+    int n = info[f].block_size;
+    int ts = clock->ts();
+    if (c == 36) { // IN
+      // Read into a copy of the block, so memory is only written
+      // (and the write recorded) once the transfer went through
+      std::vector<Word> block(buf, buf + n);
+      if (iolog != nullptr && iolog->is_replaying()) {
+        int ret = iolog->replay_in(f, ts, blocknum, block.data(), n);
+        // Logged input arrived later (terminal): keep waiting
+        if (ret > 0 && info[f].type == DevType::TERMINAL)
+          return IO_RETRY;
+        if (ret != 0)
+          return IO_ERR;
+      } else {
+        int ret = handlers[f].in ?
+          handlers[f].in(blocknum, block.data(), n) :
+          read_words(f, blocknum, block.data(), n);
+        if (ret < 0)
+          return ret;
+      }
+      if (history != nullptr) {
+        for (int k = 0; k < n; k++)
+          history->log_mem((int) m + k);
+      }
+      if (watch != nullptr) {
+        for (int k = 0; k < n; k++)
+          watch->check((int) m + k);
       }
-    } else if (info[f].fmt == Format::CHAR) {
-      // TODO
-    } else if (info[f].fmt == Format::CARD) {
-      // TODO
+      if (mem_prof != nullptr) {
+        for (int k = 0; k < n; k++)
+          mem_prof->write((int) m + k);
+      }
+      std::copy(block.begin(), block.end(), buf);
+      if (iolog != nullptr && iolog->is_recording())
+        iolog->log_in(f, ts, blocknum, buf, n);
+    } else { // OUT
+      if (mem_prof != nullptr) {
+        for (int k = 0; k < n; k++)
+          mem_prof->read((int) m + k);
+      }
+      int ret = handlers[f].out ?
+        handlers[f].out(blocknum, buf, n) :
+        write_words(f, blocknum, buf, n);
+      if (ret < 0)
+        return IO_ERR;
+      if (iolog != nullptr && iolog->is_recording())
+        iolog->log_out(f, ts, blocknum, buf, n);
+      if (iolog != nullptr && iolog->is_replaying() &&
+          iolog->check_out(f, ts, blocknum, buf, n) < 0)
+        return IO_ERR;
     }
-  } else if (c == 37) { // IOC
+    if (info[f].storage == StorageType::FIXED_SIZE)
+      pos[f] += 1; // block number will be incremented after read/write
+  } else if (c == 35) { // IOC
     if (info[f].type == DevType::MAGNETIC_TAPE) {
       if (m == 0)
         pos[f] = 0;
       else
         pos[f] += m;
     } else if (info[f].type == DevType::DISK) {
-      pos[f] = core->x;
+      pos[f] = regs->x;
     } else if (info[f].type == DevType::LINE_PRINTER) {
       dev[f].write_block(
           (void *)&LINE_PRINTER_CLEAR[0],
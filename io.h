@@ -1,14 +1,92 @@
+#include <cstdint>
+#include <functional>
+
 class MixDev;
+class MixTape;
+class MixIOLog;
+class MixConsole;
+class MixHistory;
+struct MixWatch;
+class MixMemProfile;
 struct DevInfo;
 class MixClock;
 
 constexpr int IO_ERR = -1;
 constexpr int IO_BLK = -2;
+// Device has no data yet, try the operation again later
+// (internal to MixIO, never returned to the CPU)
+constexpr int IO_RETRY = -3;
+
+/*
+ * Where device contents live.
+ * FILE -> host files (one per device, see MixIO constructor)
+ * MEMORY -> process memory only. Nothing is opened on the host
+ *   unless explicitly requested with MixIO::load_dev/dump_dev.
+ * COMPRESSED -> same as FILE, except magnetic tapes are stored
+ *   as compressed tape images (see tape.h), kept in memory while
+ *   in use and written back when the device is closed.
+ */
+enum class DevBackend { FILE, MEMORY, COMPRESSED };
+
+/*
+ * Host handler for a device (see MixIO::set_handler), called with
+ * the block number (-1 for stream devices) and the n words of the
+ * block being transferred:
+ *   in   fills buf for an IN. Return 0, IO_RETRY if there's no data
+ *        yet (the device stays busy, and the IN is tried again
+ *        later), or IO_ERR.
+ *   out  takes buf from an OUT. Return 0 or IO_ERR.
+ * Either can be left empty, to use the device as usual.
+ */
+struct DevHandler {
+  std::function<int(int blocknum, Word *buf, int n)> in;
+  std::function<int(int blocknum, const Word *buf, int n)> out;
+};
+
+/*
+ * Histogram of host latencies: bucket k counts the samples that took
+ * [2^k, 2^(k+1)) ns (bucket 0 also counts 0 ns).
+ */
+constexpr int LAT_BUCKETS = 40;
+
+struct LatencyHist {
+  uint64_t count[LAT_BUCKETS] = {};
+  uint64_t n = 0;
+  uint64_t total_ns = 0;
+  void add(uint64_t ns);
+  // Upper bound (ns, exclusive) of the bucket holding percentile p
+  // (0..100)
+  uint64_t percentile(double p) const;
+};
+
+/*
+ * I/O telemetry of one device (see MixIO::get_dev_stats).
+ * Times are MIX time (u), except the host latencies.
+ *   ops        operations staged
+ *   busy       time the device was busy (staging to finish)
+ *   stall      time the CPU waited for the device to be free
+ *              (blocking IN/OUT/IOC and JBUS *)
+ *   stalls     instructions that waited
+ *   polls      JBUS/JRED on the device
+ *   syscalls   host syscalls (FILE backend)
+ *   read_lat, write_lat   host time in MixDev::read_block/write_block
+ */
+struct DevStats {
+  uint64_t ops = 0;
+  uint64_t busy = 0;
+  uint64_t stall = 0;
+  uint64_t stalls = 0;
+  uint64_t polls = 0;
+  uint64_t syscalls = 0;
+  LatencyHist read_lat;
+  LatencyHist write_lat;
+};
 
 class MixIO {
 public:
   MixIO(
       MixCore *core, // owned by caller
+      DevBackend backend = DevBackend::FILE,
       std::string tape_prefix = "./dev/t",
       std::string disk_prefix = "./dev/d",
       std::string card_punch = "./dev/cp0",
@@ -17,12 +95,15 @@ public:
       std::string terminal = "./dev/term0",
       std::string paper_tape = "./dev/pt0"
   );
+  ~MixIO();
   void init (MixClock *clock);
   /*
    * Called by the CPU to execute I/O instructions
-   * (coprocess)
+   * (coprocess). regs holds the registers of the CPU issuing it
+   * (for indexing, and X for disks), read again when the operation
+   * runs.
    */
-  int execute(Word w);
+  int execute(Word w, MixCore *regs);
   /*
    * Perform the I/O operations and completions (if any)
    * corresponding to the current clock tick.
@@ -38,6 +119,101 @@ public:
    * Return -1 if device is currently free.
    */
   int free_ts(int f);
+  /*
+   * Replace the contents of device f with the given host file,
+   * or write the contents of device f out to the given host file.
+   * Only supported for the MEMORY backend (and COMPRESSED tapes).
+   * Return IO_ERR on failure (invalid f, or FILE backend).
+   */
+  int load_dev(int f, std::string filename);
+  int dump_dev(int f, std::string filename);
+  /*
+   * Deterministic I/O record/replay (see iolog.h).
+   * record: log every completed IN/OUT transfer to filename.
+   * replay: serve IN transfers from the log at filename, and check
+   *   OUT transfers against it. A mismatch fails the transfer.
+   * Return IO_ERR if the log can't be opened.
+   * stop_log: flush and stop either one.
+   */
+  int record(std::string filename);
+  int replay(std::string filename);
+  void stop_log();
+  /*
+   * Bridge the terminal (unit 19) to this process's stdin/stdout
+   * (see term.h). While bridged, an IN from the terminal with no
+   * complete input line available leaves the device busy and is
+   * retried, so JBUS/JRED see a busy device and the emulator never
+   * blocks on the host.
+   * The helper thread only runs between start_console() and
+   * stop_console(), ie. while the machine is running.
+   */
+  void bridge_terminal(bool on);
+  bool is_bridged() { return bridged; }
+  void start_console();
+  void stop_console();
+  /*
+   * Called by the run loop after each tick: if the CPU has nothing to
+   * do but wait for a console line that isn't there yet, wait for
+   * input (for as long as the retry takes in MIX time, 1u ~ 1us)
+   * instead of spinning the clock.
+   */
+  void pace() {
+    if (idle_us > 0)
+      wait_console();
+  }
+  /*
+   * Append the controller state (in-flight operations and block
+   * positions) to out, or restore it from in at offset i (advancing
+   * i). Device contents aren't included.
+   * Return IO_ERR if in is truncated.
+   */
+  void save_state(std::vector<char>& out);
+  int load_state(const std::vector<char>& in, size_t& i);
+  /*
+   * Same, followed by the state of every device (see
+   * MixDev::save_state), the record/replay log (see
+   * MixIOLog::save_state) and the console (bridged or not, and its
+   * unread input), for full checkpoints.
+   * load_checkpoint stages everything first, and returns IO_ERR
+   * without changing anything if in is truncated or corrupt, was
+   * saved with a different backend, or its I/O log is gone.
+   */
+  void save_checkpoint(std::vector<char>& out);
+  int load_checkpoint(const std::vector<char>& in, size_t& i);
+  /*
+   * Counter bumped whenever the controller state changes, so callers
+   * can tell when it needs saving again.
+   */
+  long get_changes() { return changes; }
+  // Number of I/O operations staged so far, for c = 35 (IOC), 36, 37
+  uint64_t get_staged(int c) { return staged[c - 35]; }
+  /*
+   * Telemetry, called by the CPU: the instruction about to execute
+   * waited u for device f to be free, or polled it (JBUS/JRED).
+   */
+  void note_stall(int f, int u);
+  void note_poll(int f);
+  // Telemetry of device f so far (see DevStats)
+  void get_dev_stats(int f, DevStats& s);
+  /*
+   * Report the telemetry of every device used so far (utilization
+   * over the MIX time elapsed), with their host latency histograms.
+   * Empty if no device was used.
+   */
+  std::string stats_to_str();
+  // Log memory written by IN transfers (not owned)
+  void set_history(MixHistory *h) { history = h; }
+  // Check memory written by IN transfers against watchpoints
+  // (not owned)
+  void set_watch(MixWatch *w) { watch = w; }
+  // Count memory accessed by IN/OUT transfers in p (not owned)
+  void set_mem_profile(MixMemProfile *p) { mem_prof = p; }
+  /*
+   * Serve the transfers of device f with h instead of its contents
+   * (replacing any handler set before). Return IO_ERR for an
+   * invalid f.
+   */
+  int set_handler(int f, DevHandler h);
 
 private:
   MixCore *core;
@@ -49,12 +225,38 @@ private:
   std::vector<int> do_io_ts;
   std::vector<int> finish_ts;
   std::vector<Word> cur_inst;
+  // registers of the CPU that issued cur_inst
+  std::vector<MixCore *> cur_regs;
+  // host handlers per device (empty if none)
+  std::vector<DevHandler> handlers;
   // only used for fixed-size block devices
   std::vector<int> pos;
+  // record/replay log (owned), only allocated once used
+  MixIOLog *iolog = nullptr;
+  // stdin/stdout bridge for the terminal (owned), only allocated
+  // once used
+  MixConsole *console = nullptr;
+  bool bridged = false;
+  // wall time to wait for console input before the next tick (us)
+  int idle_us = 0;
+  void wait_console();
+  long changes = 0;
+  uint64_t staged[3] = {};
+  // per device telemetry, except for the host side (kept by MixDev)
+  std::vector<DevStats> dev_stats;
+  MixHistory *history = nullptr;
+  MixWatch *watch = nullptr;
+  MixMemProfile *mem_prof = nullptr;
+  // move one block between memory and device f, converting
+  // from/to the device format
+  // read_words returns IO_RETRY if there's no data yet, write_words
+  // IO_ERR if the block runs past the end of the device
+  int read_words(int f, int blocknum, Word *buf, int n);
+  int write_words(int f, int blocknum, Word *buf, int n);
   // do the actual in/out/ioc operation
   // runs at do_io_ts after the operation
   // has been staged
-  int do_io(Word w);
+  int do_io(Word w, MixCore *regs);
 };
 
 // Information below needed for compilation
@@ -85,26 +287,104 @@ struct DevInfo {
   int time_to_finish;
 };
 
+/*
+ * The state of a device as of a checkpoint, checked but not applied
+ * yet (see MixDev::stage_state).
+ */
+struct DevState {
+  // MEMORY
+  size_t rpos = 0;
+  std::vector<char> data;
+  // FILE
+  long off = 0;
+  // COMPRESSED (owned)
+  MixTape *tape = nullptr;
+  DevState() = default;
+  DevState(const DevState&) = delete;
+  DevState& operator=(const DevState&) = delete;
+  ~DevState();
+};
+
 /*
  * Lightweight low-level resource object per device
  * to handle file descriptor read/write/seek
+ * (or the equivalent on an in-memory buffer).
  *
  * Don't handle errors gracefully, just throw errors -> terminate.
  */
 class MixDev {
 public:
-  // FIXED_SIZE -> open and set size to sz
-  // STREAM -> open with append mode, and don't set size
-  MixDev(std::string filename, StorageType storage, size_t sz);
+  // Nothing is opened until the first call to open().
+  // FILE backend:
+  //   FIXED_SIZE -> open and set size to sz
+  //   STREAM -> open with append mode, and don't set size
+  // MEMORY backend:
+  //   FIXED_SIZE -> zero filled buffer of size sz (allocated as
+  //     blocks are written)
+  //   STREAM -> empty buffer, appended to by writes and consumed
+  //     in order by reads
+  // COMPRESSED backend (FIXED_SIZE only):
+  //   compressed image of sz bytes in blocks of block_sz bytes
+  MixDev(std::string filename, StorageType storage, size_t sz,
+      DevBackend backend = DevBackend::FILE, size_t block_sz = 0);
+  MixDev(MixDev&& other);
+  MixDev(const MixDev&) = delete;
+  MixDev& operator=(const MixDev&) = delete;
   ~MixDev();
+  // Open the underlying file (if not already open), and make sure
+  // it has the expected size. No-op for the MEMORY backend.
+  void open();
   // Read data into the given dest of the given size
   // (in bytes), from the given offset in the device file.
   // If off is -1, don't seek before reading.
-  void read_block(void *dest, int off, size_t sz);
+  void read_block(void *dest, long off, size_t sz);
   // Write data from the given src of the given size
   // (in bytes), to the given offset in the device file.
   // If off is -1, don't seek before writing.
-  void write_block(void *src, int off, size_t sz);
+  // Return IO_ERR, and write nothing, if the data runs past the end
+  // of a FIXED_SIZE device.
+  int write_block(void *src, long off, size_t sz);
+  // MEMORY/COMPRESSED backend only: replace contents with the
+  // given host file, or write them out to it.
+  void load(std::string filename);
+  void dump(std::string filename);
+  /*
+   * Checkpoint support. save_state appends what's needed to resume
+   * the device to out:
+   *   MEMORY -> read position (uint64) and contents
+   *   FILE -> file offset (uint64, where streams read from)
+   *   COMPRESSED -> the compressed image (see tape.h)
+   * FILE contents stay in their host files, which must be left
+   * unchanged until the checkpoint is restored.
+   * stage_state reads the len bytes at in[i] into st, without
+   * changing the device, and returns IO_ERR if they're corrupt.
+   * commit_state then switches the device over to st.
+   */
+  void save_state(std::vector<char>& out);
+  int stage_state(const std::vector<char>& in, size_t i, size_t len,
+      DevState& st);
+  void commit_state(DevState& st);
+  DevBackend get_backend() { return backend; }
+  // Name of the device (its file name, without the directory)
+  std::string get_name();
+  // Host side telemetry (syscalls, read_lat and write_lat) in s
+  void get_host_stats(DevStats& s);
 private:
+  std::string filename;
+  StorageType storage;
+  size_t sz;
+  DevBackend backend;
+  size_t block_sz;
   int fd = -1;
+  // COMPRESSED backend image (owned), loaded on open()
+  MixTape *tape = nullptr;
+  // MEMORY backend contents. FIXED_SIZE buffers only grow as far
+  // as the furthest write; anything past the end reads as zero.
+  std::vector<char> data;
+  // MEMORY backend, STREAM only: next byte to be read
+  size_t rpos = 0;
+  // host side telemetry
+  uint64_t syscalls = 0;
+  LatencyHist read_lat;
+  LatencyHist write_lat;
 };
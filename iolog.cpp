@@ -0,0 +1,246 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cerrno>
+#include <string.h>
+#include "dbg.h"
+#include "sys.h"
+#include "core.h"
+#include "iolog.h"
+
+const char IOLOG_MAGIC[] = "MIXIOLG1";
+constexpr size_t IOLOG_MAGIC_SIZE = 8;
+// Flush recorded data to the file once this much is pending
+constexpr size_t IOLOG_FLUSH_SIZE = 1 << 16;
+
+constexpr int IOLOG_IN = 0;
+constexpr int IOLOG_OUT = 1;
+
+constexpr uint32_t IOLOG_OFF = 0;
+constexpr uint32_t IOLOG_RECORDING = 1;
+constexpr uint32_t IOLOG_REPLAYING = 2;
+
+uint64_t digest_words(const Word *src, int n) {
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (int k = 0; k < n; k++) {
+    // Hash the sign and bytes (not the overflow bit)
+    Byte b[6] = {
+      (Byte)(src[k].sgn() == Sign::NEG),
+      src[k].b(1), src[k].b(2), src[k].b(3), src[k].b(4), src[k].b(5)
+    };
+    for (Byte x : b) {
+      h ^= x;
+      h *= 0x100000001b3ULL;
+    }
+  }
+  return h;
+}
+
+MixIOLog::~MixIOLog() {
+  stop();
+}
+
+void MixIOLog::record(std::string filename) {
+  stop();
+  LOG_INFO(io, "Recording I/O log to ", filename);
+  out.open(filename, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw Sys_error(errno);
+  }
+  out.write(IOLOG_MAGIC, IOLOG_MAGIC_SIZE);
+  recording = true;
+  this->filename = filename;
+}
+
+void MixIOLog::replay(std::string filename) {
+  stop();
+  LOG_INFO(io, "Replaying I/O log from ", filename);
+  read_file(filename, log);
+  if (log.size() < IOLOG_MAGIC_SIZE ||
+      memcmp(&log[0], IOLOG_MAGIC, IOLOG_MAGIC_SIZE) != 0) {
+    LOG_WARN(io, "Not an I/O log: ", filename);
+    throw Sys_error(EINVAL);
+  }
+  rpos = IOLOG_MAGIC_SIZE;
+  replaying = true;
+  this->filename = filename;
+}
+
+void MixIOLog::stop() {
+  if (recording) {
+    flush();
+    out.close();
+  }
+  recording = false;
+  replaying = false;
+  log.clear();
+  rpos = 0;
+  filename.clear();
+}
+
+void MixIOLog::flush() {
+  out.write(buf.data(), buf.size());
+  out.flush();
+  buf.clear();
+}
+
+void MixIOLog::put_key(int kind, int f, int ts, int block) {
+  buf.push_back((char) kind);
+  buf.push_back((char) f);
+  put_varint(buf, (uint32_t) ts);
+  put_varint(buf, (uint32_t)(block + 1));
+}
+
+int MixIOLog::match_key(int kind, int f, int ts, int block) {
+  if (rpos + 2 > log.size()) {
+    LOG_WARN(io, "I/O replay ran past end of log at (f, ts)", f, ts);
+    return -1;
+  }
+  int lkind = log[rpos++];
+  int lf = log[rpos++];
+  uint32_t uts, ublock;
+  if (get_varint(log, rpos, uts) < 0 || get_varint(log, rpos, ublock) < 0) {
+    LOG_WARN(io, "Corrupt I/O log record at (f, ts)", f, ts);
+    return -1;
+  }
+  int lts = (int) uts;
+  int lblock = ((int) ublock) - 1;
+  if (lkind != kind || lf != f || lts != ts || lblock != block) {
+    LOG_WARN(io, "I/O replay mismatch, expected (kind, f, ts, block)",
+        lkind, lf, lts, lblock);
+    LOG_WARN(io, "                        but got (kind, f, ts, block)",
+        kind, f, ts, block);
+    return -1;
+  }
+  return 0;
+}
+
+void MixIOLog::log_in(int f, int ts, int block, const Word *src, int n) {
+  put_key(IOLOG_IN, f, ts, block);
+  put_varint(buf, (uint32_t) n);
+  buf.insert(buf.end(), (const char *)src, (const char *)(src + n));
+  if (buf.size() >= IOLOG_FLUSH_SIZE)
+    flush();
+}
+
+void MixIOLog::log_out(int f, int ts, int block, const Word *src, int n) {
+  put_key(IOLOG_OUT, f, ts, block);
+  uint64_t h = digest_words(src, n);
+  buf.insert(buf.end(), (const char *)&h, (const char *)&h + sizeof(h));
+  if (buf.size() >= IOLOG_FLUSH_SIZE)
+    flush();
+}
+
+int MixIOLog::replay_in(int f, int ts, int block, Word *dest, int n) {
+  // Peek: the same input, but logged at a later ts?
+  size_t peek = rpos;
+  if (peek + 2 <= log.size() &&
+      log[peek] == IOLOG_IN && log[peek+1] == f) {
+    peek += 2;
+    uint32_t lts, lblock;
+    if (get_varint(log, peek, lts) == 0 &&
+        get_varint(log, peek, lblock) == 0 &&
+        ((int) lblock) - 1 == block && (int) lts > ts)
+      return 1;
+  }
+  if (match_key(IOLOG_IN, f, ts, block) < 0)
+    return -1;
+  uint32_t ln;
+  if (get_varint(log, rpos, ln) < 0 || (int) ln != n ||
+      rpos + n * sizeof(Word) > log.size()) {
+    LOG_WARN(io, "I/O replay input size mismatch (logged, wanted)", ln, n);
+    return -1;
+  }
+  memcpy(dest, &log[rpos], n * sizeof(Word));
+  rpos += n * sizeof(Word);
+  return 0;
+}
+
+int MixIOLog::check_out(int f, int ts, int block, const Word *src, int n) {
+  if (match_key(IOLOG_OUT, f, ts, block) < 0)
+    return -1;
+  uint64_t h = 0;
+  if (rpos + sizeof(h) <= log.size())
+    memcpy(&h, &log[rpos], sizeof(h));
+  rpos += sizeof(h);
+  if (h != digest_words(src, n)) {
+    LOG_WARN(io, "I/O replay output digest mismatch at (f, ts)", f, ts);
+    return -1;
+  }
+  return 0;
+}
+
+void MixIOLog::save_state(std::vector<char>& out) {
+  uint64_t pos = 0;
+  if (recording) {
+    flush();
+    pos = (uint64_t) this->out.tellp();
+  } else if (replaying) {
+    pos = rpos;
+  }
+  put_u32(out, recording ? IOLOG_RECORDING :
+      replaying ? IOLOG_REPLAYING : IOLOG_OFF);
+  put_u32(out, (uint32_t) filename.size());
+  out.insert(out.end(), filename.begin(), filename.end());
+  put_u64(out, pos);
+}
+
+int MixIOLog::stage_state(const std::vector<char>& in, size_t& i,
+    IOLogState& st) {
+  st.mode = get_u32(in, i);
+  uint32_t len = get_u32(in, i);
+  if (st.mode > IOLOG_REPLAYING || i + len + 8 > in.size()) {
+    LOG_WARN(io, "Truncated I/O log state");
+    return -1;
+  }
+  st.filename.assign(in.begin() + i, in.begin() + i + len);
+  i += len;
+  st.pos = get_u64(in, i);
+  if (st.mode == IOLOG_OFF)
+    return 0;
+  // The log must still hold everything up to the checkpoint
+  try {
+    if (st.mode == IOLOG_REPLAYING) {
+      read_file(st.filename, st.log);
+      if (st.log.size() < IOLOG_MAGIC_SIZE ||
+          memcmp(&st.log[0], IOLOG_MAGIC, IOLOG_MAGIC_SIZE) != 0 ||
+          st.pos < IOLOG_MAGIC_SIZE || st.pos > st.log.size()) {
+        LOG_WARN(io, "I/O log doesn't match the checkpoint: ", st.filename);
+        return -1;
+      }
+    } else {
+      int fd = open_read(st.filename);
+      size_t sz = get_size(fd);
+      close_noerr(fd);
+      if (st.pos < IOLOG_MAGIC_SIZE || st.pos > sz) {
+        LOG_WARN(io, "I/O log doesn't match the checkpoint: ", st.filename);
+        return -1;
+      }
+    }
+  } catch (Sys_error &e) {
+    LOG_WARN(io, "Can't open the checkpoint's I/O log ", st.filename, e.err);
+    return -1;
+  }
+  return 0;
+}
+
+void MixIOLog::commit_state(IOLogState& st) {
+  stop();
+  if (st.mode == IOLOG_REPLAYING) {
+    LOG_INFO(io, "Replaying I/O log from ", st.filename, st.pos);
+    log.swap(st.log);
+    rpos = st.pos;
+    replaying = true;
+  } else if (st.mode == IOLOG_RECORDING) {
+    LOG_INFO(io, "Recording I/O log to ", st.filename, st.pos);
+    // Drop whatever was recorded after the checkpoint
+    close_noerr(open_and_resize(st.filename, st.pos));
+    out.open(st.filename, std::ios::binary | std::ios::app);
+    if (!out)
+      throw Sys_error(errno);
+    recording = true;
+  } else {
+    return;
+  }
+  filename = st.filename;
+}
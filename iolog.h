@@ -0,0 +1,104 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+/*
+ * Deterministic I/O record/replay log.
+ *
+ * While recording, every completed IN/OUT transfer is appended to
+ * the log, keyed by device, clock ts and block number (-1 for
+ * stream devices). IN records carry the words that were read, OUT
+ * records carry a 64 bit FNV-1a digest of the words written.
+ *
+ * While replaying, IN transfers are served from the log instead
+ * of the devices, and OUT transfers are checked against the logged
+ * digests. Any mismatch (different device/ts/block, different
+ * output, or running off the end of the log) is an error.
+ *
+ * File format (native byte order):
+ *   "MIXIOLG1"                         8 byte magic
+ *   records:
+ *     kind (0 = IN, 1 = OUT), f         1 byte each
+ *     ts, block + 1                     varints
+ *     IN: word count (varint), words    sizeof(Word) bytes each
+ *     OUT: digest                       8 bytes
+ *
+ * Throw Sys_error on failure to open/read the log file.
+ */
+/*
+ * The state of a log as of a checkpoint, checked but not applied yet
+ * (see MixIOLog::stage_state).
+ */
+struct IOLogState {
+  // 0 = off, 1 = recording, 2 = replaying
+  uint32_t mode = 0;
+  std::string filename;
+  uint64_t pos = 0;
+  // replaying: the whole log
+  std::vector<char> log;
+};
+
+class MixIOLog {
+public:
+  // Start recording to filename (truncated)
+  void record(std::string filename);
+  // Start replaying from filename
+  void replay(std::string filename);
+  // Flush and stop recording/replaying
+  void stop();
+  ~MixIOLog();
+
+  bool is_recording() { return recording; }
+  bool is_replaying() { return replaying; }
+
+  /*
+   * Recording: log a completed IN (n words now in src) or
+   * OUT (n words written from src).
+   */
+  void log_in(int f, int ts, int block, const Word *src, int n);
+  void log_out(int f, int ts, int block, const Word *src, int n);
+  /*
+   * Replaying: fill dest with the n words of the matching IN record,
+   * or check src against the matching OUT record.
+   * Return 0 on success, -1 on mismatch.
+   * replay_in returns 1 if the next record is this same input,
+   * but at a later ts (ie. the device wasn't ready yet).
+   */
+  int replay_in(int f, int ts, int block, Word *dest, int n);
+  int check_out(int f, int ts, int block, const Word *src, int n);
+  /*
+   * Checkpoint support. save_state appends the mode, the file name
+   * and the position (bytes recorded so far, or the replay position)
+   * to out.
+   * stage_state reads them back from in at offset i (advancing i),
+   * and checks them against the log file. Return -1 if in is
+   * truncated, or the file can't be the same log.
+   * commit_state then picks up where the checkpoint left off:
+   * replaying resumes at the saved position, and recording truncates
+   * the file to the saved length and appends to it.
+   */
+  void save_state(std::vector<char>& out);
+  static int stage_state(const std::vector<char>& in, size_t& i,
+      IOLogState& st);
+  void commit_state(IOLogState& st);
+
+private:
+  bool recording = false;
+  bool replaying = false;
+  std::string filename;
+  // recording: pending records, flushed to out in large chunks
+  std::ofstream out;
+  std::vector<char> buf;
+  // replaying: the whole log and the read position
+  std::vector<char> log;
+  size_t rpos = 0;
+  void put_key(int kind, int f, int ts, int block);
+  int match_key(int kind, int f, int ts, int block);
+  void flush();
+};
+
+/*
+ * 64 bit FNV-1a digest of n words
+ */
+uint64_t digest_words(const Word *src, int n);
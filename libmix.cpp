@@ -0,0 +1,138 @@
+#include <vector>
+#include <string>
+#include <bitset>
+#include <sstream>
+#include <chrono>
+#include "sys.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "machine.h"
+#include "libmix.h"
+
+struct MixMachine::Impl {
+  MixCore core;
+  Mix mix;
+  Impl() : core(), mix(&core, DevBackend::MEMORY) {}
+};
+
+MixMachine::MixMachine() : impl(std::make_unique<Impl>()) {}
+
+MixMachine::~MixMachine() = default;
+
+void MixMachine::load(const std::string& text) {
+  std::istringstream in {text};
+  impl->mix.load(in);
+}
+
+std::string MixMachine::dump() {
+  return impl->mix.to_str(true, true, true);
+}
+
+void MixMachine::clear() {
+  impl->mix.clean();
+}
+
+int MixMachine::get_pc() {
+  return impl->mix.get_pc();
+}
+
+int MixMachine::set_pc(int pc) {
+  if (pc < 0 || pc >= MEM_SIZE)
+    return -1;
+  impl->mix.set_pc(pc);
+  return 0;
+}
+
+int MixMachine::get_ts() {
+  return impl->mix.get_ts();
+}
+
+MixMachine::Stop MixMachine::run(long max_steps) {
+  int ret = 0;
+  if (max_steps < 0) {
+    ret = impl->mix.run();
+  } else {
+    // Mix::step takes an int budget
+    while (max_steps > 0 && ret == 0) {
+      int n = (max_steps > WORD_MAX) ? WORD_MAX : (int) max_steps;
+      ret = impl->mix.step(n);
+      max_steps -= n;
+    }
+  }
+  return (ret == 0) ? Stop::BUDGET :
+    (ret == TICK_HLT) ? Stop::HALT :
+    (ret == TICK_BRK) ? Stop::INTERRUPT :
+    Stop::ERROR;
+}
+
+void MixMachine::interrupt() {
+  impl->mix.request_stop();
+}
+
+static int reg_number(const std::string& name) {
+  int k = 0;
+  while (k < NUM_REGS && name != reg_name(k))
+    k++;
+  return (k == NUM_REGS) ? -1 : k;
+}
+
+int MixMachine::get_reg(const std::string& name, int& value) {
+  int k = reg_number(name);
+  if (k < 0)
+    return -1;
+  value = core_reg(&impl->core, k);
+  return 0;
+}
+
+int MixMachine::set_reg(const std::string& name, int value) {
+  int k = reg_number(name);
+  // A and X hold a word, the others 2 bytes
+  int max = (k < 2) ? WORD_MAX : ADDR_MAX;
+  if (k < 0 || value > max || value < -max)
+    return -1;
+  core_reg(&impl->core, k) = value;
+  return 0;
+}
+
+int MixMachine::get_mem(int addr, int& value) {
+  if (addr < 0 || addr >= MEM_SIZE)
+    return -1;
+  value = impl->core.memory[addr];
+  return 0;
+}
+
+int MixMachine::set_mem(int addr, int value) {
+  if (addr < 0 || addr >= MEM_SIZE ||
+      value > WORD_MAX || value < -WORD_MAX)
+    return -1;
+  impl->core.memory[addr] = value;
+  return 0;
+}
+
+int MixMachine::set_device(int unit, DevIn in, DevOut out) {
+  DevHandler h;
+  // Convert between words and native ints around the host's handlers
+  if (in) {
+    h.in = [in](int blocknum, Word *buf, int n) {
+      std::vector<int> words(n, 0);
+      int ret = in(blocknum, words.data(), n);
+      if (ret != 0)
+        return (ret > 0) ? IO_RETRY : IO_ERR;
+      for (int k = 0; k < n; k++) {
+        if (words[k] > WORD_MAX || words[k] < -WORD_MAX)
+          return IO_ERR;
+        buf[k] = words[k];
+      }
+      return 0;
+    };
+  }
+  if (out) {
+    h.out = [out](int blocknum, const Word *buf, int n) {
+      std::vector<int> words(buf, buf + n);
+      return (out(blocknum, words.data(), n) < 0) ? IO_ERR : 0;
+    };
+  }
+  return (impl->mix.set_handler(unit, h) < 0) ? -1 : 0;
+}
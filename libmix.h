@@ -0,0 +1,92 @@
+#include <string>
+#include <memory>
+#include <functional>
+
+/*
+ * Embeddable MIX machine (libmix.a).
+ *
+ * The only header a host application needs: it doesn't expose any
+ * of the emulator's own types, so hosts don't have to be rebuilt when
+ * those change. The core lives in process memory, and devices use
+ * the MEMORY backend (nothing is opened on the host) unless served
+ * by the host (see set_device). Nothing is logged.
+ *
+ * Words are passed as native ints (sign and magnitude, so -0 reads
+ * as 0), from -WORD_MAX to WORD_MAX (07777777777).
+ *
+ * Example:
+ *   MixMachine m;
+ *   m.load(listing);        // as written by mixal
+ *   m.set_pc(100);
+ *   if (m.run(1000000) == MixMachine::Stop::HALT)
+ *     m.get_mem(200, result);
+ */
+class MixMachine {
+public:
+  // Why run returned
+  enum class Stop { HALT, ERROR, BUDGET, INTERRUPT };
+
+  MixMachine();
+  ~MixMachine();
+  MixMachine(const MixMachine&) = delete;
+  MixMachine& operator=(const MixMachine&) = delete;
+
+  /*
+   * Load a core dump or program listing ("0100: + 00 00 00 02 05"
+   * per word, registers as "A: ..."), over what's in the machine.
+   * Skip all invalid lines.
+   */
+  void load(const std::string& text);
+  // The registers and all of memory, in the format load reads
+  std::string dump();
+  // Zero out registers and memory
+  void clear();
+
+  int get_pc();
+  // Return -1 if pc isn't a memory address
+  int set_pc(int pc);
+  // Clock time (u) elapsed
+  int get_ts();
+
+  /*
+   * Run until the machine halts or fails, or it has taken max_steps
+   * steps (instructions or I/O events), or forever if max_steps < 0,
+   * or until interrupt() is called.
+   * A halted machine resumes after its HLT.
+   */
+  Stop run(long max_steps = -1);
+  /*
+   * Make the current (or next) run return Stop::INTERRUPT at the end
+   * of its current step. Safe to call from another thread, or from a
+   * device handler.
+   */
+  void interrupt();
+
+  /*
+   * Registers by name (A, X, I1 to I6, J), and memory words.
+   * Return -1 for an unknown register, an invalid address, or a
+   * value out of range (index registers and J hold 2 bytes).
+   */
+  int get_reg(const std::string& name, int& value);
+  int set_reg(const std::string& name, int value);
+  int get_mem(int addr, int& value);
+  int set_mem(int addr, int value);
+
+  /*
+   * Serve device unit (0 to 20, see the MIX unit numbers) from the
+   * host: in is called to fill the block words of an IN, and out
+   * with the block words of an OUT, along with the block number (-1
+   * for stream devices, like the card reader or printer).
+   * in returns 0, 1 if there is no data yet (the device stays busy
+   * and the IN is tried again later), or -1 to fail the machine.
+   * out returns 0, or -1 to fail the machine.
+   * Either can be left empty, to keep the device in memory.
+   * Return -1 for an invalid unit.
+   */
+  using DevIn = std::function<int(int block, int *words, int n)>;
+  using DevOut = std::function<int(int block, const int *words, int n)>;
+  int set_device(int unit, DevIn in, DevOut out = nullptr);
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+};
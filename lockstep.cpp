@@ -0,0 +1,431 @@
+#include <vector>
+#include <string>
+#include <climits>
+#include "dbg.h"
+#include "sys.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "lockstep.h"
+
+// Packed words (see header)
+constexpr uint32_t SIGN = 1u << 30;
+constexpr uint32_t MAG = WORD_MAX;
+// Set by add if the sum didn't fit
+constexpr uint32_t OV = 1u << 31;
+// Bytes 1 to 3, which an index register can't hold
+constexpr uint32_t IOV = MAG & ~(uint32_t) ADDR_MAX;
+constexpr int REG_A = 0;
+constexpr int REG_X = 7;
+constexpr int REG_J = 8;
+
+static uint32_t pack(Word w) {
+  int v = w;
+  return ((w.sgn() == Sign::NEG) ? SIGN : 0) | (uint32_t) (v < 0 ? -v : v);
+}
+
+static Word unpack(uint32_t p) {
+  Word w = (int) (p & MAG);
+  return (p & SIGN) ? -w : w;
+}
+
+// Native value (-0 is 0)
+static inline int val(uint32_t p) {
+  int mag = p & MAG;
+  return (p & SIGN) ? -mag : mag;
+}
+
+// a + b, as Word::operator+ (if a is 0, the sum keeps its sign), with
+// OV set if the sum was truncated
+static inline uint32_t add(uint32_t a, uint32_t b) {
+  int sum = val(a) + val(b);
+  uint32_t mag = (uint32_t) (sum < 0 ? -sum : sum);
+  uint32_t sign = (val(a) == 0) ? (a & SIGN) : ((sum < 0) ? SIGN : 0);
+  return sign | (mag & MAG) | ((mag & SIGN) << 1);
+}
+
+// on ? a : b, without a branch, so the lane loops vectorize
+template <typename T>
+static inline T pick(bool on, T a, T b) {
+  T mask = (T) -(T) on;
+  return (a & mask) | (b & ~mask);
+}
+
+// The bytes of a field (L:R) shifted to the right end, how far, and
+// the sign if it's included
+struct FieldMask {
+  uint32_t bytes;
+  int shift;
+  uint32_t sign;
+};
+
+static FieldMask field_mask(int l, int r) {
+  int nb = r - ((l == 0) ? 1 : l) + 1;
+  return {(nb > 0) ? (1u << (6 * nb)) - 1 : 0, 6 * (5 - r),
+    (l == 0) ? SIGN : 0};
+}
+
+// p.field(l, r)
+static inline uint32_t field(uint32_t p, FieldMask fm) {
+  return ((p >> fm.shift) & fm.bytes) | (p & fm.sign);
+}
+
+// dest.with_field(src, l, r), for stores
+static inline uint32_t with_field(uint32_t dest, uint32_t src,
+    FieldMask fm) {
+  uint32_t at = fm.bytes << fm.shift;
+  return (dest & ~(at | fm.sign)) | ((src << fm.shift) & at) |
+    (src & fm.sign);
+}
+
+MixLockstep::MixLockstep(int n)
+  : n(n), mem((size_t) MEM_SIZE * n, 0), overflow(n, 0), comp(n, 0),
+    states(n, LaneState::RUN), pcs(n, 0), tss(n, 0), active(n, 0),
+    issued(n, 0), maddr(n, 0), mword(n, 0), next(n, 0) {
+  LOG_INFO(clock, "Initializing lockstep lanes, num = ", n);
+  for (auto &r : regs)
+    r.assign(n, 0);
+  scratch = new MixCore();
+  zero_out(scratch, sizeof(MixCore));
+  // No clock or I/O (see header)
+  scratch_cpu = new MixCPU(scratch);
+}
+
+MixLockstep::~MixLockstep() {
+  delete scratch_cpu;
+  delete scratch;
+}
+
+void MixLockstep::load_lane(int k, const MixCore& core) {
+  for (int w = 0; w < MEM_SIZE; w++)
+    mem[(size_t) w * n + k] = pack(core.memory[w]);
+  regs[REG_A][k] = pack(core.a);
+  regs[REG_X][k] = pack(core.x);
+  for (int i = 1; i <= 6; i++)
+    regs[i][k] = pack(core.i[i-1]);
+  regs[REG_J][k] = pack(core.j);
+  overflow[k] = (core.overflow == Overflow::ON);
+  comp[k] = (core.comp == Comp::LESS) ? -1 :
+    (core.comp == Comp::EQUAL) ? 0 : 1;
+}
+
+void MixLockstep::store_lane(int k, MixCore& core) {
+  for (int w = 0; w < MEM_SIZE; w++)
+    core.memory[w] = unpack(mem[(size_t) w * n + k]);
+  core.a = unpack(regs[REG_A][k]);
+  core.x = unpack(regs[REG_X][k]);
+  for (int i = 1; i <= 6; i++)
+    core.i[i-1] = unpack(regs[i][k]);
+  core.j = unpack(regs[REG_J][k]);
+  core.overflow = overflow[k] ? Overflow::ON : Overflow::OFF;
+  core.comp = (comp[k] < 0) ? Comp::LESS :
+    (comp[k] == 0) ? Comp::EQUAL : Comp::GREATER;
+}
+
+void MixLockstep::set_pc(int pc) {
+  for (int k = 0; k < n; k++) {
+    pcs[k] = pc;
+    states[k] = LaneState::RUN;
+  }
+}
+
+void MixLockstep::exec_scalar(const MixInst& in, int pc, int lo, int hi) {
+  for (int k = lo; k < hi; k++) {
+    if (!active[k])
+      continue;
+    MixCore *s = scratch;
+    s->a = unpack(regs[REG_A][k]);
+    s->x = unpack(regs[REG_X][k]);
+    for (int i = 1; i <= 6; i++)
+      s->i[i-1] = unpack(regs[i][k]);
+    s->j = unpack(regs[REG_J][k]);
+    s->overflow = overflow[k] ? Overflow::ON : Overflow::OFF;
+    s->comp = (comp[k] < 0) ? Comp::LESS :
+      (comp[k] == 0) ? Comp::EQUAL : Comp::GREATER;
+    // These only use M's word, if anything
+    int m = val(maddr[k]);
+    bool in_mem = (m >= 0 && m < MEM_SIZE);
+    if (in_mem)
+      s->memory[m] = unpack(mem[(size_t) m * n + k]);
+    scratch_cpu->set_pc(pc);
+    next[k] = scratch_cpu->apply(in);
+    if (in_mem)
+      mem[(size_t) m * n + k] = pack(s->memory[m]);
+    regs[REG_A][k] = pack(s->a);
+    regs[REG_X][k] = pack(s->x);
+    for (int i = 1; i <= 6; i++)
+      regs[i][k] = pack(s->i[i-1]);
+    regs[REG_J][k] = pack(s->j);
+    overflow[k] = (s->overflow == Overflow::ON);
+    comp[k] = (s->comp == Comp::LESS) ? -1 :
+      (s->comp == Comp::EQUAL) ? 0 : 1;
+  }
+}
+
+void MixLockstep::exec(const MixInst& in, int pc, int lo, int hi) {
+  int c = in.c;
+  int f = in.f;
+  uint8_t *act = active.data();
+  uint32_t *m = maddr.data();
+  int *nx = next.data();
+  uint32_t *ovf = overflow.data();
+  const uint32_t aa = pack(in.aa);
+
+  // M, for every lane
+  if (in.i == 0) {
+#pragma omp simd
+    for (int k = lo; k < hi; k++)
+      m[k] = aa;
+  } else {
+    const uint32_t *ix = regs[in.i].data();
+#pragma omp simd
+    for (int k = lo; k < hi; k++)
+      m[k] = add(aa, ix[k]) & ~OV;
+  }
+
+  // Validate M, as MixCPU::apply does, and mask off the lanes where
+  // it's invalid
+  bool uses_mem = (c >= 1 && c <= 4) || (c >= 8 && c <= 33) ||
+    (c >= 56) || (c == 5 && f == 3);
+  bool needs_addr = uses_mem || (c == 7) || (c == 34) ||
+    (c >= 38 && c <= 47);
+  if (needs_addr || c == 6) {
+    int lim = needs_addr ? MEM_SIZE : INT_MAX;
+#pragma omp simd
+    for (int k = lo; k < hi; k++) {
+      int mv = val(m[k]);
+      bool ok = (mv >= 0) & (mv < lim);
+      nx[k] = pick(act[k] & !ok, PC_ERR, nx[k]);
+      act[k] = act[k] & ok;
+    }
+  }
+  if (c >= 34 && c <= 38) {
+    // I/O: lanes have no coprocessor
+    for (int k = lo; k < hi; k++)
+      nx[k] = pick((bool) act[k], PC_ERR, nx[k]);
+    return;
+  }
+  if (c == 3 || c == 4 || c == 6 || (c == 5 && f != 2)) {
+    exec_scalar(in, pc, lo, hi);
+    return;
+  }
+
+  // M's word for every lane: with no index register, M is the same
+  // everywhere and its row of mem is used in place, otherwise it's
+  // gathered into mword (and scattered back for stores)
+  uint32_t *w = nullptr;
+  bool gathered = false;
+  if (uses_mem) {
+    if (in.i == 0) {
+      w = &mem[(size_t) val(aa) * n];
+    } else {
+      w = mword.data();
+      gathered = true;
+      const uint32_t *mp = mem.data();
+      for (int k = lo; k < hi; k++)
+        w[k] = mp[(size_t) (act[k] ? val(m[k]) : 0) * n + k];
+    }
+  }
+
+  FieldMask fm = field_mask(in.l, in.r);
+  if (c == 0) {
+    // NOP
+  } else if (c == 1 || c == 2) {
+    // ADD, SUB (which adds -M)
+    uint32_t *a = regs[REG_A].data();
+    uint32_t neg = (c == 2) ? SIGN : 0;
+#pragma omp simd
+    for (int k = lo; k < hi; k++) {
+      uint32_t sum = add(a[k], w[k] ^ neg);
+      ovf[k] = pick(act[k] & (sum >> 31), 1u, ovf[k]);
+      a[k] = pick((bool) act[k], sum & ~OV, a[k]);
+    }
+  } else if (c == 5) {
+    // HLT
+    for (int k = lo; k < hi; k++)
+      nx[k] = pick((bool) act[k], PC_HLT, nx[k]);
+  } else if (c == 7) {
+    // MOVE, lane by lane: every lane has its own I1
+    uint32_t *i1 = regs[1].data();
+    for (int k = lo; k < hi; k++) {
+      if (!act[k])
+        continue;
+      int from = val(m[k]);
+      int to = val(i1[k]);
+      for (int j = 0; j < f; j++) {
+        if (from + j >= MEM_SIZE || to + j < 0 || to + j >= MEM_SIZE) {
+          LOG_DEBUG(cpu, "Move command out of memory in lane ", k);
+          nx[k] = PC_ERR;
+          break;
+        }
+        mem[(size_t) (to + j) * n + k] = mem[(size_t) (from + j) * n + k];
+      }
+      if (nx[k] != PC_ERR)
+        i1[k] = add(i1[k], (uint32_t) f) & ~OV;
+    }
+  } else if (c >= 8 && c < 24) {
+    // LD*, LD*N (the field of -M)
+    uint32_t *reg = regs[c % 8].data();
+    uint32_t neg = (c >= 16) ? SIGN : 0;
+#pragma omp simd
+    for (int k = lo; k < hi; k++)
+      reg[k] = pick((bool) act[k], field(w[k] ^ neg, fm), reg[k]);
+  } else if (c >= 24 && c < 33) {
+    // ST*, STJ
+    const uint32_t *reg = regs[(c == 32) ? REG_J : c % 8].data();
+#pragma omp simd
+    for (int k = lo; k < hi; k++)
+      w[k] = pick((bool) act[k], with_field(w[k], reg[k], fm), w[k]);
+  } else if (c == 33) {
+    // STZ
+#pragma omp simd
+    for (int k = lo; k < hi; k++)
+      w[k] = pick((bool) act[k], with_field(w[k], 0, fm), w[k]);
+  } else if (c == 39 || (c >= 40 && c < 48)) {
+    // Jumps: global (on the flags), and on a register
+    uint32_t *j = regs[REG_J].data();
+    const uint32_t *reg = regs[c % 8].data();
+    const int32_t *cmp = comp.data();
+    const uint32_t link = (uint32_t) ((pc + 1) % MEM_SIZE);
+    // Each jump is taken on some of the outcomes -1, 0, 1 (bits 0 to
+    // 2 of want) of: the sign of the register, comp, or for JOV and
+    // JNOV the overflow toggle (0 or 1). JMP and JSJ take any.
+    static const int FLAG_WANT[10] = {7, 7, 4, 2, 1, 2, 4, 6, 5, 3};
+    static const int REG_WANT[7] = {1, 2, 4, 6, 5, 3, 0};
+    int want = (c == 39) ? FLAG_WANT[f] : REG_WANT[f];
+    uint32_t lt = want & 1, eq = (want >> 1) & 1, gt = want >> 2;
+    int from = (c != 39) ? 0 : (f == 2 || f == 3) ? 1 : 2;
+    // JSJ keeps J, JOV clears the overflow it jumped on
+    uint32_t links = !(c == 39 && f == 1);
+    uint32_t clears = (c == 39 && f == 2);
+#pragma omp simd
+    for (int k = lo; k < hi; k++) {
+      int v = val(reg[k]);
+      int s = pick(from == 0, (v > 0) - (v < 0),
+          pick(from == 1, (int) ovf[k], cmp[k]));
+      uint32_t taken = act[k] &
+        (((s < 0) & lt) | ((s == 0) & eq) | ((s > 0) & gt));
+      nx[k] = pick((bool) taken, val(m[k]), nx[k]);
+      j[k] = pick((bool) (taken & links), link, j[k]);
+      ovf[k] = pick((bool) (taken & clears), 0u, ovf[k]);
+    }
+  } else if (c >= 48 && c < 56) {
+    // INC*, DEC* (which adds -M), ENT*, ENN*
+    uint32_t *reg = regs[c % 8].data();
+    bool wide = (c % 8 == REG_A || c % 8 == REG_X);
+    uint32_t neg = (f == 1 || f == 3) ? SIGN : 0;
+    bool enter = (f >= 2);
+#pragma omp simd
+    for (int k = lo; k < hi; k++) {
+      uint32_t v = m[k] ^ neg;
+      v = pick(enter, v, add(reg[k], v));
+      ovf[k] = pick(act[k] & wide & (v >> 31), 1u, ovf[k]);
+      reg[k] = pick((bool) act[k], v & ~OV, reg[k]);
+    }
+  } else {
+    // CMP*
+    const uint32_t *reg = regs[c % 8].data();
+    int32_t *cmp = comp.data();
+#pragma omp simd
+    for (int k = lo; k < hi; k++) {
+      int rf = val(field(reg[k], fm));
+      int mf = val(field(w[k], fm));
+      cmp[k] = pick((bool) act[k], (rf > mf) - (rf < mf), cmp[k]);
+    }
+  }
+
+  if (gathered && c >= 24 && c <= 33) {
+    uint32_t *mp = mem.data();
+    for (int k = lo; k < hi; k++) {
+      if (act[k])
+        mp[(size_t) val(m[k]) * n + k] = w[k];
+    }
+  }
+
+  // An index register that doesn't fit in 2 bytes stops the lane
+  for (int i = 1; i <= 6; i++) {
+    const uint32_t *reg = regs[i].data();
+#pragma omp simd
+    for (int k = lo; k < hi; k++)
+      nx[k] = pick(act[k] & ((reg[k] & IOV) != 0), PC_ERR, nx[k]);
+  }
+}
+
+void MixLockstep::issue(uint32_t w, int pc, int lo, int hi) {
+  MixInst in;
+  bool valid = (MixCPU::decode(unpack(w), in) == 0);
+  for (int k = lo; k < hi; k++) {
+    next[k] = valid ? (pc + 1) % MEM_SIZE : PC_ERR;
+    // exec masks off the lanes that fail early
+    issued[k] = active[k];
+  }
+  if (valid)
+    exec(in, pc, lo, hi);
+  for (int k = lo; k < hi; k++) {
+    if (!issued[k])
+      continue;
+    tss[k] += op_time(in.c, in.f);
+    lane_insts++;
+    if (next[k] == PC_HLT) {
+      // same as MixCPU::tick, resume after the HLT
+      pcs[k] = (pc + 1) % MEM_SIZE;
+      states[k] = LaneState::HALT;
+    } else if (next[k] < 0) {
+      states[k] = LaneState::ERR;
+    } else {
+      pcs[k] = next[k];
+    }
+  }
+}
+
+int MixLockstep::run(long max_issues) {
+  LOG_INFO(clock, "Running lockstep lanes, max issues = ", max_issues);
+  std::vector<int> diverged;
+  while (issues < max_issues) {
+    // Re-convergence: issue for the lowest pc
+    int pc = MEM_SIZE;
+    for (int k = 0; k < n; k++) {
+      if (states[k] == LaneState::RUN && pcs[k] < pc)
+        pc = pcs[k];
+    }
+    if (pc == MEM_SIZE)
+      break;
+    // The lanes at pc with the first one's instruction word
+    const uint32_t *row = &mem[(size_t) pc * n];
+    int lo = -1, hi = 0;
+    uint32_t w = 0;
+    diverged.clear();
+    for (int k = 0; k < n; k++) {
+      active[k] = 0;
+      if (states[k] != LaneState::RUN || pcs[k] != pc)
+        continue;
+      if (lo < 0) {
+        lo = k;
+        w = row[k];
+      }
+      if (row[k] == w) {
+        active[k] = 1;
+        hi = k + 1;
+      } else {
+        diverged.push_back(k);
+      }
+    }
+    issues++;
+    issue(w, pc, lo, hi);
+    // Divergent code: each of the others decodes its own word
+    for (int k : diverged) {
+      for (int j = lo; j < hi; j++)
+        active[j] = 0;
+      active[k] = 1;
+      lo = k;
+      hi = k + 1;
+      issue(row[k], pc, lo, hi);
+    }
+  }
+  int running = 0;
+  for (int k = 0; k < n; k++)
+    running += (states[k] == LaneState::RUN);
+  LOG_INFO(clock,
+      "Lockstep stopped, (issues, running lanes) = ", issues, running);
+  return running;
+}
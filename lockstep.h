@@ -0,0 +1,89 @@
+#include <vector>
+#include <cstdint>
+
+/*
+ * Lockstep engine: many machines ("lanes") running the same program
+ * on different data.
+ *
+ * Lanes are stored as a structure of arrays: each register, flag and
+ * memory word is an array with one entry per lane, so every step of
+ * an issue (indexing, loading M, the operation, storing) is a single
+ * loop across the lanes, which the compiler turns into SIMD code
+ * (lockstep.o is built with -O2 -fopenmp-simd). Words are packed in
+ * 32 bits, sign and magnitude (sign in bit 30, then bytes 1 to 5 from
+ * the top), so fields are shifts and masks.
+ *
+ * Each issue picks the lowest pc among the running lanes, decodes the
+ * instruction there once, and applies it to every lane at that pc.
+ * Lanes whose control flow diverged (different pc) are masked off and
+ * wait; since they wait at a higher pc, they re-converge with the
+ * others at the join point (eg. a loop exit or the end of an if).
+ * A lane whose instruction word differs (eg. self-modifying code)
+ * decodes its own copy, and runs on its own.
+ *
+ * Loads, stores, ADD and SUB, transfers, comparisons, jumps, MOVE and
+ * HLT run on the lanes directly. The rest (MUL, DIV, NUM, CHAR,
+ * shifts) are run lane by lane by a MixCPU on a scratch core.
+ *
+ * Lanes have no I/O coprocessor: an I/O instruction stops the lane
+ * with an error. Each lane keeps its own MIX time, as though it had
+ * run alone.
+ */
+class MixLockstep {
+public:
+  enum class LaneState { RUN, HALT, ERR };
+
+  MixLockstep(int n);
+  ~MixLockstep();
+  int size() { return n; }
+  // Copy core (registers, flags and memory) into lane k, for
+  // loading programs and data, or lane k into core, for results
+  void load_lane(int k, const MixCore& core);
+  void store_lane(int k, MixCore& core);
+  void set_pc(int pc);
+  /*
+   * Run until every lane has stopped, or max_issues instructions
+   * have been issued. Return the number of lanes still running.
+   */
+  int run(long max_issues);
+
+  LaneState state(int k) { return states[k]; }
+  int pc(int k) { return pcs[k]; }
+  int ts(int k) { return tss[k]; }
+  // Number of issues, and of lane-instructions they executed.
+  // (lane_insts / (issues * size) is the lane utilization)
+  long get_issues() { return issues; }
+  long get_lane_insts() { return lane_insts; }
+private:
+  int n;
+  // word w of lane k is at mem[w * n + k]
+  std::vector<uint32_t> mem;
+  // registers by the number in the opcodes (c % 8: A, I1-I6, X),
+  // then J
+  std::vector<uint32_t> regs[9];
+  // flags (32 bits too, so the loops that mix them with registers
+  // vectorize): overflow 0 or 1, comp -1, 0, 1 for LESS, EQUAL,
+  // GREATER
+  std::vector<uint32_t> overflow;
+  std::vector<int32_t> comp;
+  std::vector<LaneState> states;
+  std::vector<int> pcs;
+  std::vector<int> tss;
+  // per issue, for each lane: taking part (active, and as issued,
+  // before exec masks off failed lanes), M (packed), M's memory word
+  // (when it's gathered), and the next pc (or PC_ERR/PC_HLT)
+  std::vector<uint8_t> active;
+  std::vector<uint8_t> issued;
+  std::vector<uint32_t> maddr;
+  std::vector<uint32_t> mword;
+  std::vector<int> next;
+  // for the instructions run lane by lane (owned)
+  MixCore *scratch;
+  MixCPU *scratch_cpu;
+  long issues = 0;
+  long lane_insts = 0;
+  // issue w at pc to the active lanes in [lo, hi), and retire them
+  void issue(uint32_t w, int pc, int lo, int hi);
+  void exec(const MixInst& in, int pc, int lo, int hi);
+  void exec_scalar(const MixInst& in, int pc, int lo, int hi);
+};
@@ -0,0 +1,836 @@
+#include <vector>
+#include <string>
+#include <bitset>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <charconv>
+#include <string.h>
+#include <errno.h>
+#include "sys.h"
+#include "dbg.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "history.h"
+#include "status.h"
+#include "stats.h"
+#include "profile.h"
+#include "memprof.h"
+#include "srcmap.h"
+#include "ring.h"
+#include "trace.h"
+#include "machine.h"
+
+// Publish the live status every this many clock ticks while running
+constexpr uint32_t STATUS_EVERY = 4096;
+
+constexpr char SNAP_MAGIC[] = "MIXSNAP1";
+constexpr char CKPT_MAGIC[] = "MIXCHKPT";
+// Bump whenever the checkpoint layout changes
+constexpr uint32_t CKPT_VERSION = 2;
+
+Mix::Mix(MixCore *core, DevBackend backend) {
+  this->core = core;
+  init(backend);
+}
+
+Mix::Mix(std::string core_file, DevBackend backend) {
+  void *raw_core = nullptr;
+  LOG_INFO(mix, "Initializing core at", core_file);
+  open_and_map(
+    core_file,
+    CORE_MAP_SIZE,
+    raw_core,
+    this->core_fd
+  );
+  this->core = (MixCore *) raw_core;
+  init(backend);
+  status = status_init((char *) raw_core + STATUS_OFF);
+  cpu->set_status(status);
+  publish(RunState::IDLE);
+}
+
+Mix::Mix(const MixSnapshot& snap, DevBackend backend) {
+  LOG_INFO(mix, "Forking core at snapshot offset", snap.core_off);
+  core = (MixCore *) map_private(snap.fd, snap.core_off, sizeof(MixCore));
+  core_cow = true;
+  init(backend);
+  size_t i = 0;
+  load_exec(snap.state, i);
+  // Validated when the snapshot was opened
+  io->load_state(snap.state, i);
+}
+
+void Mix::init(DevBackend backend) {
+  cpu = new MixCPU(core);
+  io = new MixIO(core, backend);
+  clock = new MixClock(cpu, io);
+  cpu->init(clock, io);
+  io->init(clock);
+}
+
+Mix::~Mix() {
+  if (history != nullptr)
+    delete history;
+  if (prof != nullptr)
+    delete prof;
+  if (graph != nullptr)
+    delete graph;
+  if (mem_prof != nullptr)
+    delete mem_prof;
+  if (srcmap != nullptr)
+    delete srcmap;
+  if (tracer != nullptr)
+    delete tracer;
+  if (clock != nullptr)
+    delete clock;
+  if (io != nullptr)
+    delete io;
+  if (cpu != nullptr)
+    delete cpu;
+  if (core_fd != -1) {
+    publish(RunState::EXITED);
+    unmap_and_close(core, CORE_MAP_SIZE, core_fd);
+  }
+  if (core_cow)
+    unmap(core, sizeof(MixCore));
+}
+
+void Mix::load(std::string filename) {
+  load_core(core, filename);
+  // Can't rewind across a change made outside of a step
+  if (history != nullptr)
+    record_history(true);
+}
+
+void Mix::load(std::istream& in) {
+  load_core(core, in);
+  if (history != nullptr)
+    record_history(true);
+}
+
+void load_core(MixCore *core, std::string filename) {
+  LOG_INFO(mix, "loading ", filename);
+  std::ifstream fs {filename};
+  load_core(core, fs);
+  fs.close();
+}
+
+void load_core(MixCore *core, std::istream& fs) {
+  for (std::string s; fs >> s; ) {
+    // Registers
+    if (s[0] == 'A') {
+      fs >> core->a;
+    } else if (s[0] == 'X') {
+      fs >> core->x;
+    } else if (s[0] == 'I') {
+      // I[1] to I[6]
+      int i = (s.size() > 2) ? s[2] - '0' : 0;
+      if (i >= 1 && i <= 6) {
+        fs >> core->i[i-1];
+      } else {
+        fs.setstate(std::ios_base::failbit);
+      }
+    } else if (s[0] == 'J') {
+      fs >> core->j;
+    // Memory
+    } else {
+      int i = -1;
+      std::from_chars(s.data(), s.data() + s.size(), i);
+      if (i >= 0 && i < MEM_SIZE) {
+        fs >> core->memory[i];
+      } else {
+        fs.setstate(std::ios_base::failbit);
+      }
+    }
+    if (fs.fail()) {
+      fs.clear();
+      // discard remainder of line and continue
+      fs.unget();
+      getline(fs, s);
+    }
+  }
+}
+
+std::string Mix::to_str(
+    bool include_registers,
+    bool include_memory,
+    bool include_zeros,
+    bool include_exec) {
+  std::string s = core_to_str(
+      core, include_registers, include_memory, include_zeros);
+  if (include_exec) {
+    std::stringstream ss;
+    ss << "  TS: " << clock->ts() << std::endl;
+    ss << "  PC: " << cpu->get_pc() << std::endl;
+    s += ss.str();
+  }
+  return s;
+}
+
+std::string core_to_str(
+    MixCore *core,
+    bool include_registers,
+    bool include_memory,
+    bool include_zeros) {
+  std::stringstream ss;
+  if (include_registers) {
+    ss << "   A: " << core->a << std::endl;
+    ss << "   X: " << core->x << std::endl;
+    for (int i = 0; i < 6; i++) {
+      ss << "I[" << (i+1) << "]: " << core->i[i] << std::endl;
+    }
+    ss << "   J: " << core->j << std::endl;
+  }
+  if (include_memory) {
+    for (int i = 0; i < MEM_SIZE; i++) {
+      if (core->memory[i] != 0 || include_zeros) {
+        ss.width(4);
+        ss.fill('0');
+        ss << i << ": " << core->memory[i] << std::endl;
+      }
+    }
+  }
+  return ss.str();
+}
+
+void Mix::dump(std::string filename) {
+  LOG_INFO(mix, "dumping to ", filename);
+  std::ofstream fs {filename};
+  fs << to_str(true, true, true);
+  fs.close();
+}
+
+void Mix::snapshot(std::string filename) {
+  LOG_INFO(mix, "Saving snapshot to", filename);
+  std::vector<char> state;
+  save_exec(state);
+  io->save_state(state);
+
+  // Page align the core, so forks can map it directly
+  size_t header = 8 + 2 * 4 + state.size();
+  size_t page = page_size();
+  size_t core_off = (header + page - 1) / page * page;
+  std::vector<char> out;
+  out.reserve(core_off + sizeof(MixCore));
+  out.insert(out.end(), SNAP_MAGIC, SNAP_MAGIC + 8);
+  put_u32(out, (uint32_t) core_off);
+  put_u32(out, (uint32_t) state.size());
+  out.insert(out.end(), state.begin(), state.end());
+  out.resize(core_off, 0);
+  const char *raw = (const char *) core;
+  out.insert(out.end(), raw, raw + sizeof(MixCore));
+  write_file(filename, out.data(), out.size());
+}
+
+void Mix::checkpoint(std::string filename) {
+  LOG_INFO(mix, "Saving checkpoint to", filename);
+  std::vector<char> out(CKPT_MAGIC, CKPT_MAGIC + 8);
+  put_u32(out, CKPT_VERSION);
+  put_u32(out, sizeof(MixCore));
+  const char *raw = (const char *) core;
+  out.insert(out.end(), raw, raw + sizeof(MixCore));
+  save_exec(out);
+  io->save_checkpoint(out);
+  write_file(filename, out.data(), out.size());
+}
+
+// Whether the pc, previous_ts and clock ts at in[i] (as written by
+// save_exec) are ones the machine can resume from
+static bool valid_exec(const std::vector<char>& in, size_t i) {
+  if (i + 3 * 4 > in.size())
+    return false;
+  int pc = (int) get_u32(in, i);
+  int previous_ts = (int) get_u32(in, i);
+  int ts = (int) get_u32(in, i);
+  return pc >= 0 && pc < MEM_SIZE && previous_ts >= 0 &&
+    previous_ts <= ts;
+}
+
+int Mix::restore(std::string filename) {
+  LOG_INFO(mix, "Restoring checkpoint from", filename);
+  std::vector<char> in;
+  read_file(filename, in);
+  size_t i = 8;
+  if (in.size() < 8 || memcmp(in.data(), CKPT_MAGIC, 8) != 0) {
+    LOG_WARN(mix, "Not a checkpoint file");
+    return -1;
+  }
+  uint32_t version = get_u32(in, i);
+  if (version != CKPT_VERSION) {
+    LOG_WARN(mix, "Unsupported checkpoint version", version);
+    return -1;
+  }
+  if (get_u32(in, i) != sizeof(MixCore) ||
+      i + sizeof(MixCore) + 3 * 4 > in.size()) {
+    LOG_WARN(mix, "Truncated or mismatched core in checkpoint");
+    return -1;
+  }
+  size_t core_at = i;
+  i += sizeof(MixCore);
+  size_t exec_at = i;
+  if (!valid_exec(in, exec_at)) {
+    LOG_WARN(mix, "Invalid pc or clock in checkpoint");
+    return -1;
+  }
+  i += 3 * 4;
+  // Everything else is validated by now, so this is all or nothing
+  if (io->load_checkpoint(in, i) < 0)
+    return -1;
+  memcpy((void *) core, &in[core_at], sizeof(MixCore));
+  load_exec(in, exec_at);
+  // The history leads somewhere else now
+  if (history != nullptr)
+    record_history(true);
+  return 0;
+}
+
+void Mix::save_exec(std::vector<char>& out) {
+  put_u32(out, (uint32_t) cpu->get_pc());
+  put_u32(out, (uint32_t) cpu->get_previous_ts());
+  put_u32(out, (uint32_t) clock->ts());
+}
+
+void Mix::load_exec(const std::vector<char>& in, size_t& i) {
+  cpu->set_pc((int) get_u32(in, i));
+  cpu->set_previous_ts((int) get_u32(in, i));
+  clock->set_ts((int) get_u32(in, i));
+}
+
+MixSnapshot::MixSnapshot(std::string filename) {
+  LOG_INFO(mix, "Opening snapshot", filename);
+  fd = open_read(filename);
+  std::vector<char> header(8 + 2 * 4);
+  size_t i = 8;
+  if (seek_read(fd, header.data(), 0, header.size()) <
+      (int) header.size() || memcmp(header.data(), SNAP_MAGIC, 8) != 0) {
+    close_noerr(fd);
+    throw Sys_error(EINVAL);
+  }
+  core_off = get_u32(header, i);
+  size_t state_len = get_u32(header, i);
+  // The core must be all there (a short core would fault when
+  // touched), and the state must fit before it
+  size_t file_sz = get_size(fd);
+  if (core_off % page_size() != 0 || core_off < header.size() ||
+      core_off > file_sz || file_sz - core_off < sizeof(MixCore) ||
+      state_len > core_off - header.size()) {
+    close_noerr(fd);
+    throw Sys_error(EINVAL);
+  }
+  state.resize(state_len);
+  if (seek_read(fd, state.data(), -1, state.size()) < (int) state.size()) {
+    close_noerr(fd);
+    throw Sys_error(EINVAL);
+  }
+  // Check the pc/clock and I/O state now, rather than in every fork
+  if (!valid_exec(state, 0)) {
+    close_noerr(fd);
+    throw Sys_error(EINVAL);
+  }
+  MixCore scratch;
+  MixIO io(&scratch, DevBackend::MEMORY);
+  i = 3 * 4;
+  if (io.load_state(state, i) < 0) {
+    close_noerr(fd);
+    throw Sys_error(EINVAL);
+  }
+}
+
+MixSnapshot::~MixSnapshot() {
+  close_noerr(fd);
+}
+
+int Mix::load_dev(int f, std::string filename) {
+  return io->load_dev(f, filename);
+}
+
+int Mix::dump_dev(int f, std::string filename) {
+  return io->dump_dev(f, filename);
+}
+
+int Mix::record_io(std::string filename) {
+  return io->record(filename);
+}
+
+int Mix::replay_io(std::string filename) {
+  return io->replay(filename);
+}
+
+void Mix::stop_io_log() {
+  io->stop_log();
+}
+
+void Mix::console(bool on) {
+  io->bridge_terminal(on);
+}
+
+bool Mix::console_on() {
+  return io->is_bridged();
+}
+
+int Mix::set_handler(int f, DevHandler h) {
+  return io->set_handler(f, h);
+}
+
+int Mix::step(int i) {
+  LOG_DEBUG(clock, "Stepping through i operations, i = ", i);
+  io->start_console();
+  publish(RunState::RUNNING);
+  auto start = std::chrono::steady_clock::now();
+  int start_ts = clock->ts();
+  int ret = 0;
+  while (--i >= 0) {
+    int next_ts = clock->next_ts();
+    LOG_TRACE(clock, "Next operation occurs at clock time ts", next_ts);
+    LOG_TRACE(clock, "Setting clock time to this ts and running tick", next_ts);
+    ret = tick_at(next_ts);
+    if (ret < 0) {
+      LOG_DEBUG(clock, "Failure/halt in clock tick, halting, code ", ret);
+      break;
+    }
+    ret = 0;
+  }
+  io->stop_console();
+  account(start, start_ts);
+  publish_stop(ret);
+  return ret;
+}
+
+int Mix::timestep(int i) {
+  LOG_DEBUG(clock, "Stepping through i time steps, i = ", i);
+  io->start_console();
+  publish(RunState::RUNNING);
+  auto start = std::chrono::steady_clock::now();
+  int start_ts = clock->ts();
+  int ret = 0;
+  while (--i >= 0) {
+    ret = tick_at(clock->ts() + 1);
+    if (ret < 0) {
+      LOG_DEBUG(clock, "Failure/halt in clock tick, halting, code ", ret);
+      break;
+    }
+    ret = 0;
+  }
+  io->stop_console();
+  account(start, start_ts);
+  publish_stop(ret);
+  return ret;
+}
+
+int Mix::run() {
+  LOG_INFO(clock, "Running until halt or error...");
+  io->start_console();
+  publish(RunState::RUNNING);
+  auto start = std::chrono::steady_clock::now();
+  int start_ts = clock->ts();
+  int ret;
+  while(true) {
+    int next_ts = clock->next_ts();
+    LOG_TRACE(clock, "Next operation occurs at clock time ts", next_ts);
+    LOG_TRACE(clock, "Setting clock time to this ts and running tick", next_ts);
+    ret = tick_at(next_ts);
+    if (ret < 0) {
+      LOG_DEBUG(clock, "Failure/halt in clock tick, stopping, code ", ret);
+      break;
+    }
+  }
+  io->stop_console();
+  account(start, start_ts);
+  publish_stop(ret);
+  return ret;
+}
+
+void Mix::account(std::chrono::steady_clock::time_point start,
+    int start_ts) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start);
+  host_ns += ns.count();
+  if (clock->ts() > start_ts)
+    mix_time += clock->ts() - start_ts;
+}
+
+void Mix::get_stats(MixStats& s) {
+  const uint64_t *ops = cpu->get_ops();
+  for (int c = 0; c < NUM_OPS; c++)
+    s.ops[c] = ops[c];
+  s.retired = cpu->get_retired();
+  s.ticks = ticks;
+  s.idle_ticks = idle_ticks;
+  for (int k = 0; k < 3; k++)
+    s.io_staged[k] = io->get_staged(35 + k);
+  s.host_ns = host_ns;
+  s.mix_time = mix_time;
+}
+
+void Mix::dump_stats(std::string filename) {
+  LOG_INFO(mix, "dumping stats to ", filename);
+  MixStats s;
+  get_stats(s);
+  std::ofstream fs {filename};
+  fs << stats_to_json(s);
+  fs.close();
+}
+
+std::string Mix::io_stats() {
+  return io->stats_to_str();
+}
+
+void Mix::publish(RunState state) {
+  if (status != nullptr)
+    status_publish(status, cpu->get_pc(), clock->ts(), cpu->get_retired(),
+        state);
+}
+
+void Mix::publish_stop(int ret) {
+  publish(
+      (ret == TICK_HLT) ? RunState::HALTED :
+      (ret == TICK_ERR || ret == TICK_BUS) ? RunState::ERROR :
+      RunState::IDLE);
+}
+
+// Set by Mix::interrupt (lock free, so safe in signal handlers)
+static std::atomic<bool> interrupted {false};
+
+void Mix::interrupt() {
+  interrupted.store(true, std::memory_order_relaxed);
+}
+
+void Mix::clear_interrupt() {
+  interrupted.store(false, std::memory_order_relaxed);
+}
+
+void Mix::request_stop() {
+  stop_requested.store(true, std::memory_order_relaxed);
+}
+
+int Mix::tick_at(int ts) {
+  if ((interrupted.load(std::memory_order_relaxed) &&
+        interrupted.exchange(false)) ||
+      (stop_requested.load(std::memory_order_relaxed) &&
+       stop_requested.exchange(false))) {
+    brk_reason = "interrupted";
+    return TICK_BRK;
+  }
+  if ((++ticks % STATUS_EVERY) == 0 && status != nullptr)
+    publish(RunState::RUNNING);
+  uint64_t retired = cpu->get_retired();
+  long changes = io->get_changes();
+  int ret;
+  if (history == nullptr && !breaking) {
+    ret = clock->tick_at(ts);
+  } else {
+    if (breaking && check_before(ts) < 0)
+      return TICK_BRK;
+    if (history != nullptr)
+      history->begin();
+    ret = clock->tick_at(ts);
+    if (history != nullptr)
+      history->commit();
+    if (breaking && ret >= 0 && check_after() < 0)
+      ret = TICK_BRK;
+  }
+  if (cpu->get_retired() == retired && io->get_changes() == changes)
+    idle_ticks++;
+  io->pace();
+  if (ret == TICK_ERR && tracer != nullptr && tracer->is_flight()) {
+    try {
+      tracer->dump();
+    } catch (Sys_error &e) {
+      LOG_WARN(mix, "Failed to dump the flight recorder, errno = ", e.err);
+    }
+  }
+  return ret;
+}
+
+void Mix::set_break(int addr, bool on) {
+  if (addr < 0 || addr >= MEM_SIZE)
+    return;
+  breaks.set(addr, on);
+  update_breaking();
+}
+
+void Mix::set_watch(int lo, int hi, bool on) {
+  for (int addr = (lo < 0 ? 0 : lo); addr <= hi && addr < MEM_SIZE; addr++)
+    watch.mem.set(addr, on);
+  num_watch = (int) watch.mem.count();
+  update_breaking();
+}
+
+int Mix::set_reg_watch(std::string reg, bool on, bool any, int value) {
+  int k = 0;
+  while (k < NUM_REGS && reg != reg_name(k))
+    k++;
+  if (k == NUM_REGS)
+    return -1;
+  for (auto it = reg_watches.begin(); it != reg_watches.end(); ) {
+    if (it->reg == k)
+      it = reg_watches.erase(it);
+    else
+      ++it;
+  }
+  if (on)
+    reg_watches.push_back({k, any, value, core_reg(core, k)});
+  update_breaking();
+  return 0;
+}
+
+void Mix::set_trigger(int ts) {
+  trigger_ts = ts;
+  update_breaking();
+}
+
+void Mix::clear_breaks() {
+  breaks.reset();
+  watch.mem.reset();
+  num_watch = 0;
+  reg_watches.clear();
+  trigger_ts = -1;
+  update_breaking();
+}
+
+void Mix::update_breaking() {
+  breaking = breaks.any() || num_watch > 0 || !reg_watches.empty() ||
+    trigger_ts >= 0;
+  // Only pay for store checks while memory is watched
+  cpu->set_watch(num_watch > 0 ? &watch : nullptr);
+  io->set_watch(num_watch > 0 ? &watch : nullptr);
+}
+
+int Mix::check_before(int ts) {
+  if (trigger_ts >= 0 && ts > trigger_ts) {
+    brk_reason = "trigger at ts " + std::to_string(trigger_ts);
+    trigger_ts = -1;
+    update_breaking();
+    return TICK_BRK;
+  }
+  int pc = cpu->get_pc();
+  if (cpu->next_ts() <= ts) {
+    // The CPU executes at pc on this tick
+    if (breaks.test(pc) && pc != skip_pc) {
+      brk_reason = "breakpoint at " + std::to_string(pc);
+      skip_pc = pc;
+      return TICK_BRK;
+    }
+    skip_pc = -1;
+  }
+  watch.hit = -1;
+  return 0;
+}
+
+int Mix::check_after() {
+  if (watch.hit >= 0) {
+    brk_reason = "watchpoint, wrote " + std::to_string(watch.hit);
+    return TICK_BRK;
+  }
+  int ret = 0;
+  for (auto &rw : reg_watches) {
+    Word w = core_reg(core, rw.reg);
+    bool changed = (int) w != (int) rw.last || w.sgn() != rw.last.sgn();
+    if (changed && (rw.any || (int) w == (int) rw.value)) {
+      brk_reason = std::string("register watch, ") + reg_name(rw.reg) +
+        " changed";
+      ret = TICK_BRK;
+    }
+    rw.last = w;
+  }
+  return ret;
+}
+
+void Mix::record_history(bool on) {
+  if (history != nullptr) {
+    cpu->set_history(nullptr);
+    io->set_history(nullptr);
+    delete history;
+    history = nullptr;
+  }
+  if (on) {
+    LOG_INFO(mix, "Recording execution history");
+    history = new MixHistory(core, cpu, clock, io);
+    cpu->set_history(history);
+    io->set_history(history);
+  }
+}
+
+void Mix::profile(bool on) {
+  if (prof != nullptr) {
+    cpu->set_profile(nullptr);
+    delete prof;
+    prof = nullptr;
+  }
+  if (on) {
+    LOG_INFO(mix, "Profiling execution");
+    prof = new MixProfile();
+    cpu->set_profile(prof);
+  }
+}
+
+std::string Mix::profile_report(int top_n) {
+  if (prof == nullptr)
+    return "";
+  return profile_to_str(*prof, core, top_n);
+}
+
+void Mix::dump_profile(std::string filename) {
+  if (prof == nullptr)
+    return;
+  LOG_INFO(mix, "dumping profile to ", filename);
+  std::ofstream fs {filename};
+  fs << profile_dump(*prof, core);
+  fs.close();
+}
+
+void Mix::callgraph(bool on) {
+  if (graph != nullptr) {
+    cpu->set_callgraph(nullptr);
+    delete graph;
+    graph = nullptr;
+  }
+  if (on) {
+    LOG_INFO(mix, "Profiling the call graph");
+    graph = new MixCallGraph(core);
+    cpu->set_callgraph(graph);
+  }
+}
+
+std::string Mix::callgraph_report() {
+  if (graph == nullptr)
+    return "";
+  return graph->to_str(srcmap);
+}
+
+void Mix::dump_folded(std::string filename) {
+  if (graph == nullptr)
+    return;
+  LOG_INFO(mix, "dumping folded stacks to ", filename);
+  std::ofstream fs {filename};
+  fs << graph->folded(srcmap);
+  fs.close();
+}
+
+int Mix::mem_profile(bool on, const CacheConfig& cfg) {
+  if (on && !cfg.valid())
+    return -1;
+  if (mem_prof != nullptr) {
+    cpu->set_mem_profile(nullptr);
+    io->set_mem_profile(nullptr);
+    delete mem_prof;
+    mem_prof = nullptr;
+  }
+  if (!on)
+    return 0;
+  LOG_INFO(mix, "Profiling memory accesses");
+  mem_prof = new MixMemProfile(cfg);
+  mem_prof_ts = clock->ts();
+  cpu->set_mem_profile(mem_prof);
+  io->set_mem_profile(mem_prof);
+  return 0;
+}
+
+std::string Mix::mem_report() {
+  if (mem_prof == nullptr)
+    return "";
+  int elapsed = clock->ts() - mem_prof_ts;
+  return mem_prof->to_str(elapsed > 0 ? elapsed : 0);
+}
+
+void Mix::dump_heatmap(std::string filename) {
+  if (mem_prof == nullptr)
+    return;
+  LOG_INFO(mix, "dumping memory heatmap to ", filename);
+  std::ofstream fs {filename};
+  fs << mem_prof->heatmap();
+  fs.close();
+}
+
+void Mix::trace(std::string filename) {
+  stop_trace();
+  tracer = new MixTracer(filename);
+  cpu->set_tracer(tracer);
+}
+
+void Mix::flight_record(std::string filename, size_t n) {
+  stop_trace();
+  tracer = new MixTracer(filename, n);
+  cpu->set_tracer(tracer);
+}
+
+void Mix::stop_trace() {
+  if (tracer == nullptr)
+    return;
+  cpu->set_tracer(nullptr);
+  delete tracer;
+  tracer = nullptr;
+}
+
+int Mix::load_map(std::string filename) {
+  if (srcmap == nullptr)
+    srcmap = new MixSourceMap();
+  return srcmap->load(filename);
+}
+
+std::string Mix::listing() {
+  if (srcmap == nullptr || srcmap->empty() || prof == nullptr)
+    return "";
+  return srcmap->listing(*prof);
+}
+
+int Mix::reverse_step(int i) {
+  if (history == nullptr)
+    return 0;
+  return (int) history->rewind(i);
+}
+
+int Mix::reverse_continue() {
+  if (history == nullptr)
+    return 0;
+  if (!breaks.any())
+    return (int) history->rewind(history->size());
+  // Back to the last time we were about to execute a breakpoint
+  int ct = 0;
+  while (history->size() > 0) {
+    ct += (int) history->rewind(1);
+    int pc = cpu->get_pc();
+    if (breaks.test(pc)) {
+      brk_reason = "breakpoint at " + std::to_string(pc);
+      skip_pc = pc;
+      break;
+    }
+  }
+  return ct;
+}
+
+int Mix::get_ts() {
+  return clock->ts();
+}
+
+int Mix::get_pc() {
+  return cpu->get_pc();
+}
+
+void Mix::set_pc(int pc) {
+  cpu->set_pc(pc);
+  if (history != nullptr)
+    record_history(true);
+}
+
+void Mix::clean() {
+  zero_out(core, sizeof(*core));
+  if (history != nullptr)
+    record_history(true);
+}
+
+void Mix::test() {
+  core->a = 4;
+  core->x = 5;
+  core->i[0] = 3;
+  core->i[1] = 9;
+  core->i[2] = 27;
+  core->i[3] = 81;
+  core->overflow = Overflow::ON;
+  core->memory[0] = 0xdeadbeef;
+  core->memory[3999] = 0xdeadbeef;
+}
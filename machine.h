@@ -0,0 +1,354 @@
+#include <string>
+#include <iosfwd>
+#include <cstdint>
+#include <chrono>
+#include <atomic>
+
+class MixSnapshot;
+class MixHistory;
+struct MixStatus;
+struct MixStats;
+struct MixProfile;
+class MixCallGraph;
+class MixMemProfile;
+class MixSourceMap;
+class MixTracer;
+struct CacheConfig;
+enum class RunState : uint32_t;
+
+/*
+ * A complete MIX machine: core, CPU, I/O coprocessor and clock.
+ */
+class Mix {
+public:
+  // In-memory core (owned by caller)
+  Mix(MixCore *core, DevBackend backend = DevBackend::FILE);
+  /*
+   * Mapped core (owned by class). The file also holds the live status
+   * of the machine after the core (see status.h), for monitoring.
+   */
+  Mix(std::string core_file, DevBackend backend = DevBackend::FILE);
+  /*
+   * Fork: a clone of the machine saved in snap, with its core mapped
+   * copy-on-write from the snapshot file (owned by class). Only the
+   * pages the clone writes are copied. Devices start out fresh.
+   * The snapshot can be destroyed while the clone is still in use.
+   * Unlike the other constructors, devices are in memory by default:
+   * clones run side by side, and with FILE they would all read and
+   * write the same device files under ./dev.
+   */
+  Mix(const MixSnapshot& snap, DevBackend backend = DevBackend::MEMORY);
+  ~Mix();
+  /*
+   * Load a core dump or program listing into the current
+   * Mix machine. Skip all invalid lines.
+   */
+  void load(std::string filename);
+  // The same, reading the dump/listing from in
+  void load(std::istream& in);
+  /*
+   * Dump core fields of the Mix machine to a file.
+   * See above.
+   */
+  void dump(std::string filename);
+  /*
+   * Save the machine (core, CPU, clock and I/O controller state) to
+   * a snapshot file, for forking clones (see MixSnapshot).
+   * Throw Sys_error on failure (containing errno).
+   */
+  void snapshot(std::string filename);
+  /*
+   * Save everything needed to resume the machine later (possibly in
+   * another process) to a checkpoint file, or restore the machine
+   * from one: core, pc, clock, I/O controller state including
+   * in-flight operations, device state (see MixDev::save_state), the
+   * record/replay log position and the console.
+   * Devices must use the same backend as when saved.
+   *
+   * File format (native byte order, like core dumps):
+   *   "MIXCHKPT"                        8 byte magic
+   *   version, sizeof(MixCore)          uint32 each
+   *   MixCore                           raw
+   *   pc, previous_ts, clock ts         uint32 each
+   *   I/O state                         (see MixIO::save_checkpoint)
+   *
+   * Throw Sys_error if the file can't be written/read (or the I/O
+   * log can't be reopened).
+   * restore returns -1, leaving the machine untouched, if the file
+   * isn't a valid checkpoint (of this version).
+   */
+  void checkpoint(std::string filename);
+  int restore(std::string filename);
+  /*
+   * Load/dump the contents of device f (MEMORY backend only).
+   * Return IO_ERR on failure.
+   */
+  int load_dev(int f, std::string filename);
+  int dump_dev(int f, std::string filename);
+  /*
+   * Record all device transfers to a log, or replay them from one
+   * (see MixIO::record/replay). Return IO_ERR on failure.
+   */
+  int record_io(std::string filename);
+  int replay_io(std::string filename);
+  void stop_io_log();
+  /*
+   * Bridge the terminal device to stdin/stdout while the machine
+   * is running (see MixIO::bridge_terminal).
+   */
+  void console(bool on);
+  // Whether it's bridged (restoring a checkpoint can change it)
+  bool console_on();
+  /*
+   * Serve the transfers of device f with a host handler (see
+   * MixIO::set_handler). Return IO_ERR for an invalid f.
+   */
+  int set_handler(int f, DevHandler h);
+  /*
+   * Convert core fields of the Mix machine to a string
+   * If include_registers is set, include registers in the string.
+   * If include_memory is set, include memory in the string.
+   * If include_zeros is set, keep lines for memory
+   * rows that are zero.
+   */
+  std::string to_str(
+      bool include_registers = true,
+      bool include_memory = false,
+      bool include_zeros = false,
+      bool include_exec = false);
+  // erase all values in the core (zero out memory)
+  void clean();
+  // manually set some values for orchestration test
+  void test();
+  /*
+   * Execute i operations, i time steps, or run until halt/error.
+   * Return the negative tick code (TICK_HLT, TICK_ERR, ...) if the
+   * machine stopped, or 0 if step/timestep used up its budget.
+   */
+  int step(int i);
+  int timestep(int i);
+  int run();
+  /*
+   * Keep an execution history while running, for reverse execution
+   * (see history.h). Turning it off drops the history.
+   */
+  void record_history(bool on);
+  /*
+   * Collect a frequency-count profile while running (see profile.h).
+   * Turning it on starts over from zero, turning it off drops it.
+   */
+  void profile(bool on);
+  /*
+   * Hot spot report of the top_n addresses, or write the annotated
+   * dump to a file (see profile.h). Empty/nothing written if not
+   * profiling.
+   */
+  std::string profile_report(int top_n);
+  void dump_profile(std::string filename);
+  /*
+   * Collect a call graph profile while running (see MixCallGraph).
+   * Turning it on starts over, turning it off drops it.
+   */
+  void callgraph(bool on);
+  /*
+   * Call graph report, or write its folded stacks to a file.
+   * Empty/nothing written if not profiling.
+   */
+  std::string callgraph_report();
+  void dump_folded(std::string filename);
+  /*
+   * Profile memory accesses through a simulated cache while running
+   * (see memprof.h). Turning it on starts over, turning it off drops
+   * it. Return -1 (keeping the current profile, if any) if cfg is
+   * invalid.
+   */
+  int mem_profile(bool on, const CacheConfig& cfg);
+  /*
+   * Memory access report (hit rates and heatmap), or write the per
+   * address counts to a file. Empty/nothing written if not profiling.
+   */
+  std::string mem_report();
+  void dump_heatmap(std::string filename);
+  /*
+   * Trace every instruction executed to a binary trace file (see
+   * trace.h), or keep only the last n in memory (flight recorder)
+   * and write them to the file whenever the machine fails
+   * (TICK_ERR). Either replaces any trace going on, stop_trace ends
+   * it (writing out the rest of a streamed trace).
+   * Throw Sys_error if the file can't be created.
+   */
+  void trace(std::string filename);
+  void flight_record(std::string filename, size_t n);
+  void stop_trace();
+  /*
+   * Load the source map of the program (written by mixal, see
+   * srcmap.h), for listings and to name subroutines in call graphs.
+   * Return -1 if the file can't be opened.
+   */
+  int load_map(std::string filename);
+  /*
+   * Source listing annotated with the frequency-count profile (see
+   * MixSourceMap::listing). Empty if there's no source map or not
+   * profiling.
+   */
+  std::string listing();
+  /*
+   * Rewind i steps (as counted by step), or back to the last point
+   * where the CPU was about to execute a breakpoint (see set_break),
+   * or the oldest step in the history if there was none. The history
+   * past the new position is dropped.
+   * Return the number of steps rewound.
+   */
+  int reverse_step(int i);
+  int reverse_continue();
+  /*
+   * Breakpoints. While any are set, step/timestep/run stop with
+   * TICK_BRK:
+   *   set_break: before executing the instruction at addr
+   *   set_watch: after a step that wrote memory in [lo, hi]
+   *     (stores, MOVE or IN transfers)
+   *   set_reg_watch: after a step that changed register reg (see
+   *     reg_name), or, if value is given, that made it equal value
+   *   set_trigger: before the clock passes ts (once)
+   * Resuming after a breakpoint executes the instruction it stopped
+   * before. With none set, running costs nothing extra.
+   * set_reg_watch returns -1 for an unknown register.
+   */
+  void set_break(int addr, bool on);
+  void set_watch(int lo, int hi, bool on);
+  int set_reg_watch(std::string reg, bool on, bool any = true,
+      int value = 0);
+  void set_trigger(int ts);
+  void clear_breaks();
+  // What the last TICK_BRK stopped on
+  std::string break_reason() { return brk_reason; }
+  int get_ts();
+  int get_pc();
+  // Continue execution at pc (0 to MEM_SIZE-1)
+  void set_pc(int pc);
+  MixCore *get_core() { return core; }
+  /*
+   * Performance counters since the machine was created (see
+   * stats.h), or write them to a file as JSON.
+   */
+  void get_stats(MixStats& s);
+  void dump_stats(std::string filename);
+  // Per device I/O telemetry report (see MixIO::stats_to_str)
+  std::string io_stats();
+  /*
+   * Ask the running machine to stop with TICK_BRK (as though it hit
+   * a breakpoint) at the end of its current step, or drop such a
+   * request. Process wide, and async signal safe (for SIGINT).
+   */
+  static void interrupt();
+  static void clear_interrupt();
+  /*
+   * The same, for this machine only (eg. from another thread, or a
+   * device handler). Thread safe.
+   */
+  void request_stop();
+  void do_repl();
+private:
+  MixCore *core;
+  MixCPU *cpu = nullptr;
+  MixIO *io = nullptr;
+  MixClock *clock = nullptr;
+  MixHistory *history = nullptr;
+  MixProfile *prof = nullptr;
+  MixCallGraph *graph = nullptr;
+  MixMemProfile *mem_prof = nullptr;
+  MixSourceMap *srcmap = nullptr;
+  MixTracer *tracer = nullptr;
+  // clock ts when mem_prof was started
+  int mem_prof_ts = 0;
+  int core_fd = -1;
+  // live status in the mapped core file (if any)
+  MixStatus *status = nullptr;
+  // performance counters (see get_stats)
+  uint64_t ticks = 0;
+  uint64_t idle_ticks = 0;
+  uint64_t host_ns = 0;
+  uint64_t mix_time = 0;
+  // add the time spent in step/timestep/run since start
+  void account(std::chrono::steady_clock::time_point start, int start_ts);
+  void publish(RunState state);
+  // state to publish after step/timestep/run returned ret
+  void publish_stop(int ret);
+  // Breakpoints (see set_break)
+  struct RegWatch {
+    int reg;
+    bool any;
+    Word value;
+    Word last;
+  };
+  std::bitset<MEM_SIZE> breaks;
+  MixWatch watch;
+  std::vector<RegWatch> reg_watches;
+  int trigger_ts = -1;
+  // number of memory watchpoints set
+  int num_watch = 0;
+  // true if any breakpoint is set
+  bool breaking = false;
+  // don't stop on the breakpoint we just stopped on, when resuming
+  int skip_pc = -1;
+  std::string brk_reason;
+  // Set by request_stop
+  std::atomic<bool> stop_requested {false};
+  void update_breaking();
+  int check_before(int ts);
+  int check_after();
+  // core is a private (copy-on-write) mapping
+  bool core_cow = false;
+  void init(DevBackend backend);
+  // clock->tick_at, recorded in the history
+  int tick_at(int ts);
+  // pc, previous_ts and clock ts, for snapshots/checkpoints
+  void save_exec(std::vector<char>& out);
+  void load_exec(const std::vector<char>& in, size_t& i);
+};
+
+/*
+ * A snapshot file opened for forking (see Mix::snapshot).
+ *
+ * File format (native byte order, like core dumps):
+ *   "MIXSNAP1"                          8 byte magic
+ *   core_off, state_len                 uint32 each
+ *   pc, previous_ts, clock ts           uint32 each
+ *   I/O controller state                (see MixIO::save_state)
+ *   zero padding up to core_off         (a multiple of the page size)
+ *   MixCore                             raw, like a mapped core file
+ * state_len counts the bytes from pc up to the padding.
+ *
+ * Opening reads the header only; each fork maps the core.
+ * Throw Sys_error on failure (containing errno, EINVAL if the
+ * file isn't a snapshot).
+ */
+class MixSnapshot {
+public:
+  MixSnapshot(std::string filename);
+  ~MixSnapshot();
+  MixSnapshot(const MixSnapshot&) = delete;
+  MixSnapshot& operator=(const MixSnapshot&) = delete;
+private:
+  friend class Mix;
+  int fd = -1;
+  size_t core_off = 0;
+  std::vector<char> state;
+};
+
+/*
+ * Load a core dump or program listing into the given core
+ * (what Mix::load does). Skip all invalid lines.
+ */
+void load_core(MixCore *core, std::string filename);
+void load_core(MixCore *core, std::istream& in);
+
+/*
+ * Convert core fields to a string (what Mix::to_str does, without
+ * the execution state).
+ */
+std::string core_to_str(
+    MixCore *core,
+    bool include_registers = true,
+    bool include_memory = false,
+    bool include_zeros = false);
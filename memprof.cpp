@@ -0,0 +1,104 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include "core.h"
+#include "memprof.h"
+
+// Heatmap shades, from no access to the most accessed
+static const char SHADES[] = " .:-=+*#%@";
+constexpr int HEAT_ROW = 100;
+constexpr int HEAT_CELL = 2;
+
+bool CacheConfig::valid() const {
+  return line > 0 && ways > 0 && capacity > 0 && miss_penalty >= 0 &&
+    capacity % (line * ways) == 0;
+}
+
+MixMemProfile::MixMemProfile(CacheConfig cfg)
+  : cfg(cfg), sets(cfg.capacity / (cfg.line * cfg.ways)),
+    tags(sets * cfg.ways, -1), used(sets * cfg.ways, 0),
+    dirty(sets * cfg.ways, false) {}
+
+void MixMemProfile::access(int addr, bool write) {
+  int line = addr / cfg.line;
+  int base = (line % sets) * cfg.ways;
+  now++;
+  int victim = base;
+  for (int k = base; k < base + cfg.ways; k++) {
+    if (tags[k] == line) {
+      hits[write]++;
+      used[k] = now;
+      if (write)
+        dirty[k] = true;
+      return;
+    }
+    if (used[k] < used[victim])
+      victim = k;
+  }
+  misses[write]++;
+  if (tags[victim] != -1 && dirty[victim])
+    writebacks++;
+  tags[victim] = line;
+  used[victim] = now;
+  dirty[victim] = write;
+}
+
+static double rate(uint64_t hits, uint64_t misses) {
+  return (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0;
+}
+
+std::string MixMemProfile::to_str(uint64_t mix_time) {
+  std::ostringstream out;
+  uint64_t all_misses = misses[0] + misses[1];
+  out << std::fixed << std::setprecision(1);
+  out << "cache " << cfg.capacity << " words, " << cfg.line
+    << " word lines, " << cfg.ways << " ways (" << sets << " sets)"
+    << std::endl;
+  out << "reads " << hits[0] + misses[0] << " hit "
+    << rate(hits[0], misses[0]) << "%  writes " << hits[1] + misses[1]
+    << " hit " << rate(hits[1], misses[1]) << "%  writebacks "
+    << writebacks << std::endl;
+  out << "mix time " << mix_time << " u, with " << cfg.miss_penalty
+    << " u per miss " << mix_time + all_misses * cfg.miss_penalty << " u"
+    << std::endl;
+
+  uint64_t cells[MEM_SIZE / HEAT_CELL];
+  uint64_t max = 0;
+  for (int k = 0; k < MEM_SIZE / HEAT_CELL; k++) {
+    cells[k] = 0;
+    for (int a = k * HEAT_CELL; a < (k + 1) * HEAT_CELL; a++)
+      cells[k] += reads[a] + writes[a];
+    max = (cells[k] > max) ? cells[k] : max;
+  }
+  int per_row = HEAT_ROW / HEAT_CELL;
+  for (int row = 0; row < MEM_SIZE / HEAT_ROW; row++) {
+    bool any = false;
+    for (int k = row * per_row; k < (row + 1) * per_row; k++)
+      any = any || (cells[k] > 0);
+    if (!any)
+      continue;
+    out << std::endl << std::setw(4) << std::setfill('0')
+      << row * HEAT_ROW << " |";
+    for (int k = row * per_row; k < (row + 1) * per_row; k++) {
+      // Any access shows, the rest is scaled to the hottest cell
+      int shade = (cells[k] == 0) ? 0 :
+        1 + (int) ((sizeof(SHADES) - 3) * cells[k] / max);
+      out << SHADES[shade];
+    }
+    out << "|";
+  }
+  return out.str();
+}
+
+std::string MixMemProfile::heatmap() {
+  std::ostringstream out;
+  for (int k = 0; k < MEM_SIZE; k++) {
+    if (reads[k] == 0 && writes[k] == 0)
+      continue;
+    out << std::setw(4) << std::setfill('0') << k << std::setfill(' ')
+      << ": " << reads[k] << " " << writes[k] << std::endl;
+  }
+  return out.str();
+}
@@ -0,0 +1,68 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Geometry of the simulated data cache (sizes in words), and the
+ * extra MIX time (u) each miss would cost.
+ */
+struct CacheConfig {
+  int line = 8;
+  int ways = 2;
+  int capacity = 256;
+  int miss_penalty = 10;
+  // Valid if positive, and capacity is a multiple of line * ways
+  bool valid() const;
+};
+
+/*
+ * Memory access profile: every effective address read or written by
+ * the CPU (arithmetic, loads, compares, stores, MOVE) and by I/O
+ * block transfers, counted per address, and run through a set
+ * associative, write-allocate, write-back cache with LRU replacement.
+ * Instruction fetches aren't counted.
+ *
+ * Collected while set on MixCPU and MixIO (see Mix::mem_profile).
+ */
+class MixMemProfile {
+public:
+  MixMemProfile(CacheConfig cfg);
+  void read(int addr) {
+    reads[addr]++;
+    access(addr, false);
+  }
+  void write(int addr) {
+    writes[addr]++;
+    access(addr, true);
+  }
+  /*
+   * Report: the cache hit rates, and the MIX time elapsed (given,
+   * where every access takes the same time) next to the time with
+   * the miss penalty added; then a heatmap of the accesses, one row
+   * per 100 words (rows without any left out), each character
+   * standing for 2 words:
+   *   0100 |  .:=#@@@#=:.    ...
+   * from ' ' (none) to '@' (the most accessed).
+   */
+  std::string to_str(uint64_t mix_time);
+  /*
+   * Per address counts, for every address accessed:
+   *   0100: 12 3
+   * (reads, then writes)
+   */
+  std::string heatmap();
+private:
+  CacheConfig cfg;
+  int sets;
+  uint64_t reads[MEM_SIZE] = {};
+  uint64_t writes[MEM_SIZE] = {};
+  // sets * ways entries: line number (-1 if empty), last use, dirty
+  std::vector<int> tags;
+  std::vector<uint64_t> used;
+  std::vector<bool> dirty;
+  uint64_t now = 0;
+  uint64_t hits[2] = {};
+  uint64_t misses[2] = {};
+  uint64_t writebacks = 0;
+  void access(int addr, bool write);
+};
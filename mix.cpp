@@ -1,229 +1,28 @@
+#include <iostream>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <cstring>
+#include <signal.h>
 #include "sys.h"
 #include "dbg.h"
 #include "core.h"
 #include "io.h"
 #include "cpu.h"
 #include "clock.h"
+#include "stats.h"
+#include "memprof.h"
+#include "machine.h"
+#include "ring.h"
+#include "runner.h"
 
 
-class Mix {
-public:
-  // In-memory core (owned by caller)
-  Mix(MixCore *core);
-  // Mapped core (owned by class)
-  Mix(std::string core_file);
-  ~Mix();
-  /*
-   * Load a core dump or program listing into the current
-   * Mix machine. Skip all invalid lines.
-   */
-  void load(std::string filename);
-  /*
-   * Dump core fields of the Mix machine to a file.
-   * See above.
-   */
-  void dump(std::string filename);
-  /*
-   * Convert core fields of the Mix machine to a string
-   * If include_registers is set, include registers in the string.
-   * If include_memory is set, include memory in the string.
-   * If include_zeros is set, keep lines for memory
-   * rows that are zero.
-   */
-  std::string to_str(
-      bool include_registers = true,
-      bool include_memory = false,
-      bool include_zeros = false,
-      bool include_exec = false);
-  // erase all values in the core (zero out memory)
-  void clean();
-  // manually set some values for orchestration test
-  void test();
-  void step(int i);
-  void timestep(int i);
-  void run();
-  void do_repl();
-private:
-  MixCore *core;
-  MixCPU *cpu = nullptr;
-  MixIO *io = nullptr;
-  MixClock *clock = nullptr;
-  int core_fd = -1;
-};
-
-Mix::Mix(MixCore *core) {
-  this->core = core;
-  cpu = new MixCPU(core);
-  io = new MixIO(core);
-  clock = new MixClock(cpu, io);
-  cpu->init(clock, io);
-  io->init(clock);
-}
-
-Mix::Mix(std::string core_file) {
-  void *raw_core = nullptr;
-  D2("Initializing core at", core_file);
-  open_and_map(
-    core_file,
-    sizeof(MixCore),
-    raw_core,
-    this->core_fd
-  );
-  this->core = (MixCore *) raw_core;
-  cpu = new MixCPU(core);
-  io = new MixIO(core);
-  clock = new MixClock(cpu, io);
-  cpu->init(clock, io);
-  io->init(clock);
-}
-
-Mix::~Mix() {
-  if (clock != nullptr)
-    delete clock;
-  if (io != nullptr)
-    delete io;
-  if (cpu != nullptr)
-    delete cpu;
-  if (core_fd != -1) {
-    unmap_and_close(core, sizeof(MixCore), core_fd);
-  }
-}
-
-void Mix::load(std::string filename) {
-  D2("loading ", filename);
-  std::ifstream fs {filename};
-  for (std::string s; fs >> s; ) {
-    // Registers
-    if (s[0] == 'A') {
-      fs >> core->a;
-    } else if (s[0] == 'X') {
-      fs >> core->x;
-    } else if (s[0] == 'I') {
-      int i = stoi(s.substr(2, 1));
-      if (i >= 1 && i <= 6) {
-        fs >> core->i[i-1];
-      } else {
-        fs.setstate(std::ios_base::failbit);
-      }
-    } else if (s[0] == 'J') {
-      fs >> core->j;
-    // Memory
-    } else {
-      int i = stoi(s);
-      if (i >= 0 && i < MEM_SIZE) {
-        fs >> core->memory[i];
-      } else {
-        fs.setstate(std::ios_base::failbit);
-      }
-    }
-    if (fs.fail()) {
-      fs.clear();
-      // discard remainder of line and continue
-      fs.unget();
-      getline(fs, s);
-    }
-  }
-  fs.close();
-}
-
-std::string Mix::to_str(
-    bool include_registers,
-    bool include_memory,
-    bool include_zeros,
-    bool include_exec) {
-  std::stringstream ss;
-  if (include_registers) {
-    ss << "   A: " << core->a << std::endl;
-    ss << "   X: " << core->x << std::endl;
-    for (int i = 0; i < 6; i++) {
-      ss << "I[" << (i+1) << "]: " << core->i[i] << std::endl;
-    }
-    ss << "   J: " << core->j << std::endl;
-  }
-  if (include_memory) {
-    for (int i = 0; i < MEM_SIZE; i++) {
-      if (core->memory[i] != 0 || include_zeros) {
-        ss.width(4);
-        ss.fill('0');
-        ss << i << ": " << core->memory[i] << std::endl;
-      }
-    }
-  }
-  if (include_exec) {
-    ss << "  TS: " << clock->ts() << std::endl;
-    ss << "  PC: " << cpu->get_pc() << std::endl;
-  }
-  return ss.str();
-}
-
-void Mix::dump(std::string filename) {
-  D2("dumping to ", filename);
-  std::ofstream fs {filename};
-  fs << to_str(true, true, true);
-  fs.close();
-}
-
-void Mix::step(int i) {
-  D2("Stepping through i operations, i = ", i);
-  while (--i >= 0) {
-    int next_ts = clock->next_ts();
-    D2("Next operation occurs at clock time ts", next_ts);
-    D2("Setting clock time to this ts and running tick", next_ts);
-    int ret = clock->tick_at(next_ts);
-    if (ret < 0) {
-      D2("Failure/halt in clock tick, halting, code ", ret);
-      return;
-    }
-  }
-}
-
-void Mix::timestep(int i) {
-  D2("Stepping through i time steps, i = ", i);
-  while (--i >= 0) {
-    int ret = clock->tick();
-    if (ret < 0) {
-      D2("Failure/halt in clock tick, halting, code ", ret);
-      return;
-    }
-  }
-}
-
-void Mix::run() {
-  D("Running until halt or error...");
-  while(true) {
-    int next_ts = clock->next_ts();
-    D2("Next operation occurs at clock time ts", next_ts);
-    D2("Setting clock time to this ts and running tick", next_ts);
-    int ret = clock->tick_at(next_ts);
-    if (ret < 0) {
-      D2("Failure/halt in clock tick, stopping, code ", ret);
-      return;
-    }
-  }
-}
-
-void Mix::clean() {
-  zero_out(core, sizeof(*core));
-}
-
-void Mix::test() {
-  core->a = 4;
-  core->x = 5;
-  core->i[0] = 3;
-  core->i[1] = 9;
-  core->i[2] = 27;
-  core->i[3] = 81;
-  core->overflow = Overflow::ON;
-  core->memory[0] = 0xdeadbeef;
-  core->memory[3999] = 0xdeadbeef;
-}
-
 void test_core() {
-  D("test_core");
+  LOG_DEBUG(mix, "test_core");
   Mix mix("./out/test.core");
   mix.test();
   // manually verify core file to check that it's good
@@ -231,9 +30,9 @@ void test_core() {
 }
 
 void test_dump() {
-  D("test_dump");
+  LOG_DEBUG(mix, "test_dump");
   MixCore core;
-  Mix m(&core);
+  Mix m(&core, DevBackend::MEMORY);
   // set some values
   m.test();
   m.dump("./out/dump_out.mix");
@@ -245,9 +44,9 @@ void test_dump() {
 }
 
 void test_lda() {
-  D("test_lda");
+  LOG_DEBUG(mix, "test_lda");
   MixCore core;
-  Mix m(&core);
+  Mix m(&core, DevBackend::MEMORY);
   // set some values
   m.load("./test/lda.mix");
   m.step(11);
@@ -255,24 +54,96 @@ void test_lda() {
 }
 
 void test_max() {
-  D("test_max");
+  LOG_DEBUG(mix, "test_max");
   MixCore core;
-  Mix m(&core);
+  Mix m(&core, DevBackend::MEMORY);
   // set some values
   m.load("./test/max.mix");
   m.run();
   m.dump("./out/max_out.mix");
 }
 
+// Tell the user why the machine stopped early (if it did)
+void report_stop(Mix& mix, int ret) {
+  if (ret == TICK_BRK)
+    std::cout << "Stopped: " << mix.break_reason() << std::endl;
+  else if (ret == TICK_ERR)
+    std::cout << "Stopped: error at " << mix.get_pc() << std::endl;
+  if (ret == TICK_HLT) {
+    std::string io_stats = mix.io_stats();
+    if (!io_stats.empty())
+      std::cout << "Halted, I/O:" << std::endl << io_stats << std::endl;
+  }
+}
+
+// Print registers/memory of a machine running in the background,
+// like the commands of the same name
+void print_inspect(MixRunner *runner, std::string cmd) {
+  MixCore core;
+  int pc, ts;
+  runner->inspect(&core, pc, ts);
+  if (cmd == "memory" || cmd == "memory_zero") {
+    std::cout << core_to_str(&core, false, true, cmd == "memory_zero")
+      << std::endl;
+    return;
+  }
+  if (cmd == "registers")
+    std::cout << core_to_str(&core);
+  std::cout << "  TS: " << ts << std::endl;
+  std::cout << "  PC: " << pc << std::endl << std::endl;
+}
+
+// Ctrl-C pauses the machine instead of killing the REPL
+void on_sigint(int) {
+  Mix::interrupt();
+}
+
 void do_repl() {
   Mix mix("./dev/core");
+  mix.record_history(true);
+  struct sigaction sa = {};
+  sa.sa_handler = on_sigint;
+  sigemptyset(&sa.sa_mask);
+  sa.sa_flags = SA_RESTART;
+  sigaction(SIGINT, &sa, nullptr);
+  // Background run (see start), and whether the terminal is bridged
+  // (the two don't mix, both want stdin)
+  MixRunner *runner = nullptr;
+  bool bg_running = false;
+  bool bridged = false;
+  // for memprof on
+  CacheConfig cache;
   while (true) {
+    if (bg_running && runner->state() != MixRunner::State::RUNNING) {
+      bg_running = false;
+      std::cout << "Background run stopped" << std::endl;
+      report_stop(mix, runner->result());
+    }
     std::cout << "(mix) => ";
     std::string cmd;
     std::cin >> cmd;
+    if (bg_running) {
+      // Only inspection is safe while running, anything else
+      // needs the machine paused
+      if (cmd == "registers" || cmd == "memory" ||
+          cmd == "memory_zero" || cmd == "ts" || cmd == "pc") {
+        print_inspect(runner, cmd);
+        continue;
+      }
+      if (cmd != "status") {
+        runner->pause();
+        bg_running = false;
+        if (cmd != "pause" && cmd != "stop")
+          std::cout << "Paused background run" << std::endl;
+      }
+    }
     if (cmd == "help") {
       std::cout << "Available commands:" << std::endl;
       std::cout << "  run" << std::endl;
+      std::cout << "  start" << std::endl;
+      std::cout << "  pause" << std::endl;
+      std::cout << "  status" << std::endl;
+      std::cout << "  stop" << std::endl;
       std::cout << "  step <i>" << std::endl;
       std::cout << "  timestep <i>" << std::endl;
       std::cout << "  load <filename>" << std::endl;
@@ -283,16 +154,83 @@ void do_repl() {
       std::cout << "  ts" << std::endl;
       std::cout << "  pc" << std::endl;
       std::cout << "  clean" << std::endl;
+      std::cout << "  record <filename>" << std::endl;
+      std::cout << "  replay <filename>" << std::endl;
+      std::cout << "  stoplog" << std::endl;
+      std::cout << "  console <on|off>" << std::endl;
+      std::cout << "  snapshot <filename>" << std::endl;
+      std::cout << "  history <on|off>" << std::endl;
+      std::cout << "  reverse-step <i>" << std::endl;
+      std::cout << "  reverse-continue" << std::endl;
+      std::cout << "  break <addr>" << std::endl;
+      std::cout << "  unbreak <addr>" << std::endl;
+      std::cout << "  watch <lo> <hi>" << std::endl;
+      std::cout << "  unwatch <lo> <hi>" << std::endl;
+      std::cout << "  watchreg <reg> <any|value>" << std::endl;
+      std::cout << "  unwatchreg <reg>" << std::endl;
+      std::cout << "  trigger <ts>" << std::endl;
+      std::cout << "  clearbreaks" << std::endl;
+      std::cout << "  checkpoint <filename>" << std::endl;
+      std::cout << "  restore <filename>" << std::endl;
+      std::cout << "  stats" << std::endl;
+      std::cout << "  stats-json <filename>" << std::endl;
+      std::cout << "  iostats" << std::endl;
+      std::cout << "  profile <on|off>" << std::endl;
+      std::cout << "  hotspots <n>" << std::endl;
+      std::cout << "  profile-dump <filename>" << std::endl;
+      std::cout << "  callgraph <on|off>" << std::endl;
+      std::cout << "  calls" << std::endl;
+      std::cout << "  callgraph-folded <filename>" << std::endl;
+      std::cout << "  memprof <on|off>" << std::endl;
+      std::cout << "  cache <line> <ways> <capacity> <miss_penalty>"
+        << std::endl;
+      std::cout << "  memreport" << std::endl;
+      std::cout << "  heatmap <filename>" << std::endl;
+      std::cout << "  srcmap <filename>" << std::endl;
+      std::cout << "  listing" << std::endl;
+      std::cout << "  trace <filename>" << std::endl;
+      std::cout << "  flight <n> <filename>" << std::endl;
+      std::cout << "  untrace" << std::endl;
+      std::cout << "  log <categories>[:<level>]" << std::endl;
     } else if (cmd == "run") {
-      mix.run();
+      Mix::clear_interrupt();
+      report_stop(mix, mix.run());
     } else if (cmd == "step") {
       int ct;
       std::cin >> ct;
-      mix.step(ct);
+      Mix::clear_interrupt();
+      report_stop(mix, mix.step(ct));
     } else if (cmd == "timestep") {
       int ct;
       std::cin >> ct;
-      mix.timestep(ct);
+      Mix::clear_interrupt();
+      report_stop(mix, mix.timestep(ct));
+    } else if (cmd == "start") {
+      if (bridged) {
+        std::cout << "Can't run in the background with the console on!"
+          << std::endl;
+        continue;
+      }
+      if (runner == nullptr)
+        runner = new MixRunner(&mix);
+      Mix::clear_interrupt();
+      runner->resume();
+      bg_running = true;
+    } else if (cmd == "pause") {
+      // (paused above if it was running)
+    } else if (cmd == "stop") {
+      // Paused above, also let go of the worker thread
+      if (runner != nullptr)
+        delete runner;
+      runner = nullptr;
+    } else if (cmd == "status") {
+      if (bg_running && runner->state() == MixRunner::State::RUNNING) {
+        std::cout << "Running in the background" << std::endl;
+        print_inspect(runner, "ts");
+      } else {
+        std::cout << "Not running" << std::endl;
+        std::cout << mix.to_str(false, false, false, true) << std::endl;
+      }
     } else if (cmd == "load") {
       std::string filename;
       std::cin >> filename;
@@ -311,10 +249,196 @@ void do_repl() {
       std::cout << mix.to_str(false, false, false, true) << std::endl;
     } else if (cmd == "pc") {
       std::cout << mix.to_str(false, false, false, true) << std::endl;
+    } else if (cmd == "stats") {
+      MixStats stats;
+      mix.get_stats(stats);
+      std::cout << stats_to_str(stats) << std::endl;
+    } else if (cmd == "profile") {
+      std::string arg;
+      std::cin >> arg;
+      mix.profile(arg == "on");
+    } else if (cmd == "hotspots") {
+      int n;
+      if (!(std::cin >> n)) {
+        std::cin.clear();
+        std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        std::cout << "Invalid count!" << std::endl;
+        continue;
+      }
+      std::string report = mix.profile_report(n);
+      std::cout << (report.empty() ? "Not profiling" : report) << std::endl;
+    } else if (cmd == "profile-dump") {
+      std::string filename;
+      std::cin >> filename;
+      mix.dump_profile(filename);
+    } else if (cmd == "callgraph") {
+      std::string arg;
+      std::cin >> arg;
+      mix.callgraph(arg == "on");
+    } else if (cmd == "calls") {
+      std::string report = mix.callgraph_report();
+      std::cout << (report.empty() ? "Not profiling calls" : report)
+        << std::endl;
+    } else if (cmd == "callgraph-folded") {
+      std::string filename;
+      std::cin >> filename;
+      mix.dump_folded(filename);
+    } else if (cmd == "memprof") {
+      std::string arg;
+      std::cin >> arg;
+      mix.mem_profile(arg == "on", cache);
+    } else if (cmd == "cache") {
+      CacheConfig cfg;
+      std::cin >> cfg.line >> cfg.ways >> cfg.capacity >> cfg.miss_penalty;
+      if (mix.mem_profile(true, cfg) < 0) {
+        std::cout << "Invalid cache (capacity must be a multiple of "
+          << "line * ways)" << std::endl;
+      } else {
+        cache = cfg;
+      }
+    } else if (cmd == "memreport") {
+      std::string report = mix.mem_report();
+      std::cout << (report.empty() ? "Not profiling memory" : report)
+        << std::endl;
+    } else if (cmd == "heatmap") {
+      std::string filename;
+      std::cin >> filename;
+      mix.dump_heatmap(filename);
+    } else if (cmd == "srcmap") {
+      std::string filename;
+      std::cin >> filename;
+      if (mix.load_map(filename) < 0)
+        std::cout << "Failed to open source map!" << std::endl;
+    } else if (cmd == "listing") {
+      std::string listing = mix.listing();
+      std::cout << (listing.empty() ?
+          "Needs a source map and profiling on" : listing) << std::endl;
+    } else if (cmd == "trace" || cmd == "flight") {
+      size_t n = 0;
+      if (cmd == "flight")
+        std::cin >> n;
+      std::string filename;
+      std::cin >> filename;
+      if (cmd == "flight" && n == 0) {
+        std::cout << "Keep at least 1 instruction!" << std::endl;
+        continue;
+      }
+      try {
+        if (cmd == "trace")
+          mix.trace(filename);
+        else
+          mix.flight_record(filename, n);
+      } catch (Sys_error &e) {
+        std::cout << "Failed to create trace, errno = " << e.err
+          << std::endl;
+      }
+    } else if (cmd == "untrace") {
+      mix.stop_trace();
+    } else if (cmd == "log") {
+      std::string spec;
+      std::cin >> spec;
+      if (log_select(spec) < 0)
+        std::cout << "Invalid log selection!" << std::endl;
+      std::cout << "Logging " << log_selection() << std::endl;
+      if (log_selected_level() < LOG_MIN_LEVEL)
+        std::cout << "(levels below " << log_level_name(LOG_MIN_LEVEL)
+          << " are compiled out, rebuild with a lower LOG_MIN_LEVEL)"
+          << std::endl;
+    } else if (cmd == "iostats") {
+      std::string io_stats = mix.io_stats();
+      std::cout << (io_stats.empty() ? "No I/O so far" : io_stats)
+        << std::endl;
+    } else if (cmd == "stats-json") {
+      std::string filename;
+      std::cin >> filename;
+      mix.dump_stats(filename);
     } else if (cmd == "clean") {
       mix.clean();
+    } else if (cmd == "record") {
+      std::string filename;
+      std::cin >> filename;
+      if (mix.record_io(filename) < 0)
+        std::cout << "Failed to open I/O log!" << std::endl;
+    } else if (cmd == "replay") {
+      std::string filename;
+      std::cin >> filename;
+      if (mix.replay_io(filename) < 0)
+        std::cout << "Failed to open I/O log!" << std::endl;
+    } else if (cmd == "stoplog") {
+      mix.stop_io_log();
+    } else if (cmd == "console") {
+      std::string arg;
+      std::cin >> arg;
+      bridged = (arg == "on");
+      mix.console(bridged);
+    } else if (cmd == "snapshot") {
+      std::string filename;
+      std::cin >> filename;
+      try {
+        mix.snapshot(filename);
+      } catch (Sys_error &e) {
+        std::cout << "Failed to save snapshot!" << std::endl;
+      }
+    } else if (cmd == "history") {
+      std::string arg;
+      std::cin >> arg;
+      mix.record_history(arg == "on");
+    } else if (cmd == "reverse-step") {
+      int ct;
+      std::cin >> ct;
+      std::cout << "Rewound " << mix.reverse_step(ct) << " steps"
+        << std::endl;
+    } else if (cmd == "reverse-continue") {
+      std::cout << "Rewound " << mix.reverse_continue() << " steps"
+        << std::endl;
+    } else if (cmd == "break" || cmd == "unbreak") {
+      int addr;
+      std::cin >> addr;
+      mix.set_break(addr, cmd == "break");
+    } else if (cmd == "watch" || cmd == "unwatch") {
+      int lo, hi;
+      std::cin >> lo >> hi;
+      mix.set_watch(lo, hi, cmd == "watch");
+    } else if (cmd == "watchreg") {
+      std::string reg, arg;
+      std::cin >> reg >> arg;
+      bool any = (arg == "any");
+      if (mix.set_reg_watch(reg, true, any, any ? 0 : atoi(arg.c_str())) < 0)
+        std::cout << "Unknown register!" << std::endl;
+    } else if (cmd == "unwatchreg") {
+      std::string reg;
+      std::cin >> reg;
+      if (mix.set_reg_watch(reg, false) < 0)
+        std::cout << "Unknown register!" << std::endl;
+    } else if (cmd == "trigger") {
+      int ts;
+      std::cin >> ts;
+      mix.set_trigger(ts);
+    } else if (cmd == "clearbreaks") {
+      mix.clear_breaks();
+    } else if (cmd == "checkpoint") {
+      std::string filename;
+      std::cin >> filename;
+      try {
+        mix.checkpoint(filename);
+      } catch (Sys_error &e) {
+        std::cout << "Failed to save checkpoint!" << std::endl;
+      }
+    } else if (cmd == "restore") {
+      std::string filename;
+      std::cin >> filename;
+      int ret = -1;
+      try {
+        ret = mix.restore(filename);
+      } catch (Sys_error &e) {
+      }
+      bridged = mix.console_on();
+      if (ret < 0)
+        std::cout << "Failed to restore checkpoint!" << std::endl;
     } else if (cmd == "") {
       std::cout << std::endl;
+      if (runner != nullptr)
+        delete runner;
       return;
     } else {
       std::cout << "Unknown command!" << std::endl;
@@ -322,13 +446,133 @@ void do_repl() {
   }
 }
 
-int main() {
-  DBG_INIT();
+/*
+ * Headless run, for scripts: no REPL, and the outcome in the exit
+ * code.
+ *   mix run <prog.mix> [--core <file>] [--max-steps <n>]
+ *       [--dump <out.mix>] [--stats]
+ * Without --core the core only lives in memory. Devices are files
+ * under ./dev, as in the REPL. Nothing is logged unless MIX_LOG is
+ * set (see dbg.h).
+ * --max-steps is a budget of clock ticks, as counted by --stats: one
+ * per instruction, and one per I/O event, so it can run out before
+ * that many instructions have retired.
+ */
+constexpr int RUN_HALT = 0;
+constexpr int RUN_ERROR = 1;
+constexpr int RUN_USAGE = 2;
+constexpr int RUN_BUDGET = 3;
+
+int run_usage() {
+  std::cout << "Usage: mix run <prog.mix> [--core <file>]"
+    << " [--max-steps <n>] [--dump <out.mix>] [--stats]" << std::endl;
+  std::cout << "--max-steps counts clock ticks (instructions and I/O"
+    << " events)" << std::endl;
+  std::cout << "Exit code: 0 halted, 1 error, 2 usage,"
+    << " 3 out of steps" << std::endl;
+  return RUN_USAGE;
+}
+
+int do_run(int argc, char **argv) {
+  if (argc < 1)
+    return run_usage();
+  std::string program = argv[0];
+  std::string core_file;
+  std::string dump_file;
+  long long max_steps = -1;
+  bool stats = false;
+  for (int k = 1; k < argc; k++) {
+    std::string opt = argv[k];
+    if (opt == "--stats") {
+      stats = true;
+      continue;
+    }
+    if (k + 1 >= argc)
+      return run_usage();
+    std::string val = argv[++k];
+    if (opt == "--core") {
+      core_file = val;
+    } else if (opt == "--dump") {
+      dump_file = val;
+    } else if (opt == "--max-steps") {
+      char *end;
+      max_steps = strtoll(val.c_str(), &end, 10);
+      if (*end != '\0' || max_steps < 0)
+        return run_usage();
+    } else {
+      return run_usage();
+    }
+  }
+  if (!std::ifstream {program}.is_open()) {
+    std::cerr << "Cannot open " << program << std::endl;
+    return RUN_USAGE;
+  }
+  if (getenv("MIX_LOG") != nullptr)
+    log_init();
+
+  MixCore core;
+  zero_out(&core, sizeof(MixCore));
+  Mix *mix = nullptr;
+  int ret = 0;
+  try {
+    mix = core_file.empty() ? new Mix(&core) : new Mix(core_file);
+    mix->load(program);
+    if (max_steps < 0) {
+      ret = mix->run();
+    } else {
+      // Mix::step takes an int budget
+      while (max_steps > 0 && ret == 0) {
+        int n = (max_steps > WORD_MAX) ? WORD_MAX : (int) max_steps;
+        ret = mix->step(n);
+        max_steps -= n;
+      }
+    }
+    if (ret < 0 && ret != TICK_HLT)
+      std::cerr << "Stopped: error at " << mix->get_pc() << std::endl;
+    if (!dump_file.empty())
+      mix->dump(dump_file);
+  } catch (Sys_error &e) {
+    // Core or device file
+    std::cerr << "Failed: " << strerror(e.err) << std::endl;
+    delete mix;
+    log_close();
+    return RUN_ERROR;
+  } catch (std::invalid_argument &e) {
+    std::cerr << "Cannot parse " << program << std::endl;
+    delete mix;
+    log_close();
+    return RUN_USAGE;
+  } catch (std::out_of_range &e) {
+    std::cerr << "Cannot parse " << program << std::endl;
+    delete mix;
+    log_close();
+    return RUN_USAGE;
+  }
+  if (stats) {
+    MixStats s;
+    mix->get_stats(s);
+    std::cout << stats_to_str(s) << std::endl;
+  }
+  delete mix;
+  log_close();
+  return (ret == TICK_HLT) ? RUN_HALT :
+    (ret == 0) ? RUN_BUDGET : RUN_ERROR;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "run")
+    return do_run(argc - 2, argv + 2);
+  if (argc > 1)
+    return run_usage();
+  log_init();
+  // Keep stdin buffering inside std::cin, so input the REPL has
+  // read ahead can be handed over to a bridged terminal.
+  std::ios::sync_with_stdio(false);
   // test_core();
   // test_dump();
   // test_lda();
   // test_max();
   do_repl();
-  DBG_CLOSE();
+  log_close();
   return 0;
 }
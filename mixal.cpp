@@ -1,3 +1,4 @@
+#include <iostream>
 #include <vector>
 #include <map>
 #include <string>
@@ -5,6 +6,7 @@
 #include <sstream>
 #include "dbg.h"
 #include "core.h"
+#include "srcmap.h"
 
 class Asm_error {
 public:
@@ -21,6 +23,7 @@ std::map<std::string, std::pair<int, int>> OP_TABLE = {
   {"NUM", {005, 0}},
   {"CHR", {005, 1}},
   {"HLT", {005, 2}},
+  {"XCHA", {005, 3}},
   {"SLA", {006, 0}},
   {"SRA", {006, 1}},
   {"SLAX", {006, 2}},
@@ -217,6 +220,20 @@ std::map<int, int> flocals = {};
 int next_literal = 0;
 std::vector<int> literals;
 
+// Source map (see srcmap.h): the source line each word was
+// assembled from, and the last global symbol defined at or before
+// it (the subroutine/table it belongs to)
+MixSourceMap sources;
+int line_no = 0;
+std::string cur_line;
+std::string cur_symbol = "-";
+
+// Assemble word w at addr, from the current source line
+void emit(int addr, Word w) {
+  words[addr] = w;
+  sources.set(addr, {line_no, cur_symbol, cur_line});
+}
+
 
 inline bool is09(char c) {
   return (c >= '0' && c <= '9');
@@ -243,7 +260,8 @@ void get_local(std::string sym, bool loc_context, int &i, bool &is_future) {
         i = ctoi(sym[0]);
         is_future = false;
       } else {
-        D2("Invalid appearance of local H symbol in addr context! ", sym);
+        LOG_WARN(assembler,
+            "Invalid appearance of local H symbol in addr context! ", sym);
         throw Asm_error(-1);
       }
     } else if (sym[1] == 'F' || sym[1] == 'B') {
@@ -251,7 +269,8 @@ void get_local(std::string sym, bool loc_context, int &i, bool &is_future) {
         i = ctoi(sym[0]);
         is_future = (sym[1] == 'F');
       } else {
-        D2("Invalid appearance of local BF symbol in loc context! ", sym);
+        LOG_WARN(assembler,
+            "Invalid appearance of local BF symbol in loc context! ", sym);
         throw Asm_error(-1);
       }
     }
@@ -264,7 +283,7 @@ Word build_word(int a, int i, int f, int c) {
   Word out_a = a;
   Word w {out_a.sgn(), {out_a.b(4), out_a.b(5),
     (Byte) i, (Byte) f, (Byte) c}};
-  D2("Assembled word: ", w);
+  LOG_DEBUG(assembler, "Assembled word: ", w);
   return w;
 }
 
@@ -272,7 +291,7 @@ Word build_word(int a, int i, int f, int c) {
 // NOTE that this also corrects any daisy chained future symbols
 void define_symbol(std::string sym, int val) {
 
-  D4("Adding symbol definition: ", sym, " = ", val);
+  LOG_DEBUG(assembler, "Adding symbol definition: ", sym, " = ", val);
   // Will be set to the most recent appearance if there
   // are earlier appearances of this symbol (before definition)
   int future_chain = -1;
@@ -290,7 +309,7 @@ void define_symbol(std::string sym, int val) {
     }
   } else { // Global
     if (globals.find(sym) != globals.end()) {
-      D4("Error: global symbol already defined! ",
+      LOG_WARN(assembler, "Error: global symbol already defined! ",
           sym, " = ", globals[sym]);
       throw Asm_error(-1);
     }
@@ -303,7 +322,8 @@ void define_symbol(std::string sym, int val) {
 
   // chase future definition chain
   while (future_chain != -1) {
-    D2("Found previous appearance of this as a future symbol at ",
+    LOG_DEBUG(assembler,
+        "Found previous appearance of this as a future symbol at ",
         future_chain);
     int tmp = words[future_chain].field(0,2);
     words[future_chain] = build_word(
@@ -319,7 +339,7 @@ void define_symbol(std::string sym, int val) {
 // Return value in &val
 // Return 0 on success, -1 on failure (not found)
 int lookup_symbol(std::string sym, int &val) {
-  D2("Looking up symbol: ", sym);
+  LOG_DEBUG(assembler, "Looking up symbol: ", sym);
   int ix;
   bool is_future;
   get_local(sym, false, ix, is_future);
@@ -329,7 +349,7 @@ int lookup_symbol(std::string sym, int &val) {
     if (is_future)
       return -1;
     if (locals.find(ix) == locals.end()) {
-      D2("Failed to find definition for past local", sym);
+      LOG_WARN(assembler, "Failed to find definition for past local", sym);
       throw Asm_error(-1);
     }
     val = locals[ix];
@@ -349,14 +369,15 @@ int lookup_symbol(std::string sym, int &val) {
 // that can be used for daisy chaining in &a
 // Throw on error.
 void add_future(std::string sym, int &a) {
-  D4("Adding future symbol reference: ", sym, " at ", star);
+  LOG_DEBUG(assembler, "Adding future symbol reference: ", sym, " at ", star);
   int ix;
   bool is_future;
   get_local(sym, false, ix, is_future);
 
   if (ix >= 0) { // Local
     if (!is_future) {
-      D2("Inconsistent! Trying to add non future local as future",
+      LOG_WARN(assembler,
+          "Inconsistent! Trying to add non future local as future",
           sym);
       throw Asm_error(-1);
     }
@@ -378,9 +399,9 @@ void add_future(std::string sym, int &a) {
 // called at END
 // throw on error
 void clean_futures() {
-  D("Cleaning up remaining future symbols...");
+  LOG_DEBUG(assembler, "Cleaning up remaining future symbols...");
   for (auto p : flocals) {
-    D3("Error! Undefined future local reference at END at",
+    LOG_WARN(assembler, "Error! Undefined future local reference at END at",
         p.first, p.second);
     throw Asm_error(-1);
   }
@@ -388,7 +409,7 @@ void clean_futures() {
     // Fake instruction:
     // <SYM> CON 0
     define_symbol(p.first, star);
-    words[star++] = 0;
+    emit(star++, 0);
   }
 }
 
@@ -397,9 +418,9 @@ void clean_futures() {
 // Throw on error
 // Note that expressions must have fully determined numerical values!
 int parse_exp(std::string s) {
-  D2("Parsing expression from: ", s);
+  LOG_DEBUG(assembler, "Parsing expression from: ", s);
   if (s == "") {
-    D("Expression cannot be empty!");
+    LOG_WARN(assembler, "Expression cannot be empty!");
     throw Asm_error(-1);
   }
   unsigned long i = 0;
@@ -430,8 +451,8 @@ int parse_exp(std::string s) {
 
     // Check for dangling binary operator (missing RHS)
     if (i == s.size()) {
-      D2("Expected atom following operator ", binop);
-      D2(" in expression ", s);
+      LOG_WARN(assembler, "Expected atom following operator ", binop);
+      LOG_WARN(assembler, " in expression ", s);
       throw Asm_error(-1);
     }
 
@@ -457,13 +478,13 @@ int parse_exp(std::string s) {
       }
       std::string atom_sym = {s, atom_start, i-atom_start};
       if (atom_sym == "") {
-        D2("Expected atom following operator ", binop);
-        D2(" in expression ", s);
+        LOG_WARN(assembler, "Expected atom following operator ", binop);
+        LOG_WARN(assembler, " in expression ", s);
         throw Asm_error(-1);
       }
       if (has_az) { // symbol atom
         if (lookup_symbol(atom_sym, atom) < 0) {
-          D3("Undefined symbol in expression!", atom_sym, s);
+          LOG_WARN(assembler, "Undefined symbol in expression!", atom_sym, s);
           throw Asm_error(-1);
         }
       } else {
@@ -488,14 +509,14 @@ int parse_exp(std::string s) {
       e = (8*e) + rhs;
     }
   }
-  D2("Found expression", e);
+  LOG_DEBUG(assembler, "Found expression", e);
   return e;
 }
 
 // Parse "W-value" (see Knuth) and return its value
 // throw on error
 int parse_w(std::string s) {
-  D2("Parsing W-value from: ", s);
+  LOG_DEBUG(assembler, "Parsing W-value from: ", s);
   unsigned long pos = 0;
   unsigned long next_pos = s.find(',', pos);
   Word w = 0;
@@ -516,7 +537,7 @@ int parse_w(std::string s) {
       int l = f / 8;
       int r = f % 8;
       if (l > r || r > 5) {
-        D2("Bad field! ", f);
+        LOG_WARN(assembler, "Bad field! ", f);
         throw Asm_error(-1);
       }
       w = w.with_field(e, l, r);
@@ -524,7 +545,7 @@ int parse_w(std::string s) {
     pos = next_pos + 1;
     next_pos = s.find(',', pos);
   } while (next_pos != std::string::npos);
-  D2("Found w-value: ", (int) w);
+  LOG_DEBUG(assembler, "Found w-value: ", (int) w);
   return w;
 }
 
@@ -539,7 +560,7 @@ int parse_w(std::string s) {
 // throw on error
 void parse_aif(std::string s, int &a, std::string &future_a,
     int &literal_a, int &i, int &f) {
-  D2("Parsing A,I, and F-values (opcode RHS) from: ", s);
+  LOG_DEBUG(assembler, "Parsing A,I, and F-values (opcode RHS) from: ", s);
   // default values
   a = -1;
   future_a = "";
@@ -552,7 +573,7 @@ void parse_aif(std::string s, int &a, std::string &future_a,
   unsigned long i_end;
   if ((i_end = s.find('(')) != std::string::npos) {
     if (s.find(')' != s.size()-1)) {
-      D2("Bad field in op address: ", s);
+      LOG_WARN(assembler, "Bad field in op address: ", s);
       throw Asm_error(-1);
     }
     fp = {s, i_end+1, s.size()-i_end-2};
@@ -564,9 +585,9 @@ void parse_aif(std::string s, int &a, std::string &future_a,
     ip = {s, a_end+1, s.size()-a_end-1};
     ap = {s, 0, a_end};
   }
-  D2("ap = ", ap);
-  D2("ip = ", ip);
-  D2("fp = ", fp);
+  LOG_DEBUG(assembler, "ap = ", ap);
+  LOG_DEBUG(assembler, "ip = ", ip);
+  LOG_DEBUG(assembler, "fp = ", fp);
 
   // Vacuous case
   if (ap == "") {
@@ -575,7 +596,7 @@ void parse_aif(std::string s, int &a, std::string &future_a,
   // Literal case
   if (ap[0] == '=') {
     if (ap.find('=', 1) != ap.size()-1) {
-      D2("Bad literal in address part!", s);
+      LOG_WARN(assembler, "Bad literal in address part!", s);
       throw Asm_error(-1);
     }
     literal_a = parse_exp({ap, 1, ap.size()-2});
@@ -610,7 +631,7 @@ void parse_aif(std::string s, int &a, std::string &future_a,
   if (fp != "") {
     f = parse_exp(fp);
   }
-  D6("Found AIF", a, future_a, literal_a, i, f);
+  LOG_DEBUG(assembler, "Found AIF", a, future_a, literal_a, i, f);
 }
 
 
@@ -623,7 +644,7 @@ void assemble_next(std::string s) {
           c == '+' || c == '-' || c == ':' ||
           c == '=' || 
           c == '(' || c == ')' || c == ',')) {
-      D2("Found invalid character: ", c);
+      LOG_WARN(assembler, "Found invalid character: ", c);
       throw Asm_error(-1);
     }
   }
@@ -633,20 +654,20 @@ void assemble_next(std::string s) {
   unsigned i = 0;
   while (i < s.size() && s[i] != ' ') i++;
   if (i == s.size()) {
-    D2("Instruction must contain an opcode, given: ", s);
+    LOG_WARN(assembler, "Instruction must contain an opcode, given: ", s);
     throw Asm_error(-1);
   }
   std::string loc {s, 0, i};
-  D2("Loc is ", loc);
+  LOG_DEBUG(assembler, "Loc is ", loc);
   while (i < s.size() && s[i] == ' ') i++;
   unsigned op_start = i;
   while (i < s.size() && s[i] != ' ') i++;
   if (i == s.size()) {
-    D2("Instruction must contain an opcode, given: ", s);
+    LOG_WARN(assembler, "Instruction must contain an opcode, given: ", s);
     throw Asm_error(-1);
   }
   std::string op {s, op_start, i-op_start};
-  D2("Opcode is ", op);
+  LOG_DEBUG(assembler, "Opcode is ", op);
   std::string addr;
   // Special case -- ALF operator can ingest spaces
   if (op == "ALF") {
@@ -655,7 +676,7 @@ void assemble_next(std::string s) {
     if (i+5 < s.size()) {
       addr = {s, i, 5};
     } else {
-      D2("ALF instruction: address too short: ", s);
+      LOG_WARN(assembler, "ALF instruction: address too short: ", s);
       throw Asm_error(-1);
     }
   } else {
@@ -668,7 +689,7 @@ void assemble_next(std::string s) {
       addr = {s, addr_start, i-addr_start};
     }
   }
-  D2("Addr is ", addr);
+  LOG_DEBUG(assembler, "Addr is ", addr);
 
   // At this point, we've tokenized the line
   // into loc (maybe empty), op, and addr (maybe empty).
@@ -683,7 +704,7 @@ void assemble_next(std::string s) {
 
     // EQU and ORIG handled at end
     if (op == "CON") {
-      words[star] = w;
+      emit(star, w);
     } else if (op == "END") {
       clean_futures();
       ended = true;
@@ -694,7 +715,7 @@ void assemble_next(std::string s) {
         CHAR_TABLE.find(addr[2]) == CHAR_TABLE.end() ||
         CHAR_TABLE.find(addr[3]) == CHAR_TABLE.end() ||
         CHAR_TABLE.find(addr[4]) == CHAR_TABLE.end()) {
-      D2("Unprintable characters passed to ALF:", addr);
+      LOG_WARN(assembler, "Unprintable characters passed to ALF:", addr);
       throw Asm_error(-1);
     }
     Word alfw {Sign::POS, {
@@ -703,11 +724,11 @@ void assemble_next(std::string s) {
       CHAR_TABLE[addr[2]],
       CHAR_TABLE[addr[3]],
       CHAR_TABLE[addr[4]]}};
-    words[star] = alfw;
+    emit(star, alfw);
   } else {
     // look up opcode
     if (OP_TABLE.find(op) == OP_TABLE.end()) {
-      D2("Unknown opcode: ", op);
+      LOG_WARN(assembler, "Unknown opcode: ", op);
       throw Asm_error(-1);
     }
     auto op_p = OP_TABLE[op];
@@ -733,9 +754,9 @@ void assemble_next(std::string s) {
     if (f == -1)
       f = op_p.second;
     int c = op_p.first;
-    D6("Adding new word to assembled map: Star, A, I, F, C =",
+    LOG_DEBUG(assembler, "Adding new word to assembled map: Star, A, I, F, C =",
         star, a, i, f, c);
-    words[star] = build_word(a, i, f, c);
+    emit(star, build_word(a, i, f, c));
   }
 
   // Finally, define the location
@@ -744,24 +765,31 @@ void assemble_next(std::string s) {
   if (loc != "") {
     for (char c : loc) {
       if (!(is09(c) || isAZ(c))) {
-        D2("Invalid character in symbol: ", c);
+        LOG_WARN(assembler, "Invalid character in symbol: ", c);
         throw Asm_error(-1);
       }
       has_az = (has_az || isAZ(c));
     }
     if (!has_az) {
-      D2("Invalid symbol! ", loc);
-      D("Symbol must contain at least one letter.");
+      LOG_WARN(assembler, "Invalid symbol! ", loc);
+      LOG_WARN(assembler, "Symbol must contain at least one letter.");
       throw Asm_error(-1);
     }
     if (op != "EQU") {
       define_symbol(loc, star);
+      // Global labels (not #H) start a new section of the source map
+      if (!(loc.size() == 2 && is09(loc[0]) && loc[1] == 'H')) {
+        cur_symbol = loc;
+        const SourceLine *src = sources.at(star);
+        if (src != nullptr && src->line == line_no)
+          sources.set(star, {src->line, loc, src->text});
+      }
     }
   }
   // Handle special operator
   if (op == "EQU") {
     if (loc == "") {
-      D("Invalid empty loc field for EQU operator");
+      LOG_WARN(assembler, "Invalid empty loc field for EQU operator");
       throw Asm_error(-1);
     }
     define_symbol(loc, w);
@@ -778,10 +806,12 @@ void assemble_next(std::string s) {
 
 void assemble_all(std::istream &in) {
   for (std::string s; getline(in, s); ) {
+    line_no++;
+    cur_line = s;
     assemble_next(s);
   }
   if (!ended) {
-    D("Never encountered END instruction");
+    LOG_WARN(assembler, "Never encountered END instruction");
     throw Asm_error(-1);
   }
 }
@@ -798,18 +828,33 @@ void dump(std::string out_file) {
   }
 }
 
+/*
+ * Dump the source map into a file: one row per assembled word,
+ *   <addr> <line> <symbol> <source line>
+ * eg.
+ *   3003 5 MAXIMUM LOOP    CMPA   X,3
+ * symbol is the last global symbol defined at or before the word
+ * ("-" if none). Words made up at END (literals, undefined symbols)
+ * map to the END line.
+ */
 int main(int argc, char **argv) {
   if (argc < 3) {
     std::cout << "Usage: mixal <input.mixal> <output.mix>"
       << std::endl;
     return 2;
   }
-  DBG_INIT();
+  log_init();
   std::string in_file = argv[1];
   std::string out_file = argv[2];
   std::ifstream in {in_file};
   assemble_all(in);
   dump(out_file);
-  DBG_CLOSE();
+  // The source map goes next to the output, as <name>.map
+  std::string map_file = out_file;
+  if (map_file.size() > 4 &&
+      map_file.compare(map_file.size() - 4, 4, ".mix") == 0)
+    map_file.resize(map_file.size() - 4);
+  sources.save(map_file + ".map");
+  log_close();
   return 0;
 }
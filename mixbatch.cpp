@@ -0,0 +1,231 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <cstdio>
+#include <charconv>
+#include "sys.h"
+#include "dbg.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "machine.h"
+#include "pool.h"
+#include "scheduler.h"
+
+/*
+ * Batch runner: run many independent MIX jobs in parallel.
+ *
+ * Manifest format, one job per line (# starts a comment):
+ *   <program.mix> <max_steps> [<unit>=<file> ...]
+ * Each job gets its own machine with in-memory devices. The given
+ * units are preloaded from the given files before the run, and
+ * dumped to <out_dir>/job<N>.<unit> after it. The final core is
+ * dumped to <out_dir>/job<N>.mix.
+ *
+ * By default each job runs to completion on a pool thread. With a
+ * slice, all jobs are set up at once and multiplexed on the threads
+ * by the coroutine scheduler, slice instructions at a time.
+ *
+ * Each distinct program is loaded only once, into a snapshot that
+ * its jobs fork (sharing the untouched pages of the core).
+ */
+
+struct Job {
+  int id;
+  std::string program;
+  int max_steps;
+  std::vector<std::pair<int, std::string>> devs;
+  // results
+  std::string status;
+  int ts = 0;
+  int pc = 0;
+  double wall_ms = 0;
+  // while running (snap is null if the program can't be read)
+  MixSnapshot *snap = nullptr;
+  Mix *mix = nullptr;
+  std::chrono::steady_clock::time_point start;
+};
+
+// Parse the manifest into jobs. Return -1 on error.
+int parse_manifest(std::string filename, std::vector<Job>& jobs) {
+  std::ifstream fs {filename};
+  if (!fs) {
+    std::cerr << "Cannot open manifest " << filename << std::endl;
+    return -1;
+  }
+  int lineno = 0;
+  for (std::string line; getline(fs, line); ) {
+    lineno++;
+    line = line.substr(0, line.find('#'));
+    std::stringstream ss {line};
+    Job job;
+    if (!(ss >> job.program))
+      continue;
+    if (!(ss >> job.max_steps)) {
+      std::cerr << filename << ":" << lineno
+        << ": expected step budget" << std::endl;
+      return -1;
+    }
+    for (std::string d; ss >> d; ) {
+      auto eq = d.find('=');
+      int unit;
+      if (eq == std::string::npos || eq == 0 ||
+          std::from_chars(d.data(), d.data() + eq, unit).ptr !=
+          d.data() + eq) {
+        std::cerr << filename << ":" << lineno
+          << ": bad device spec " << d << std::endl;
+        return -1;
+      }
+      job.devs.push_back({unit, d.substr(eq + 1)});
+    }
+    job.id = (int) jobs.size();
+    jobs.push_back(job);
+  }
+  return 0;
+}
+
+// Set up the machine for job. Return false if its program or devices
+// failed.
+bool start_job(Job& job) {
+  job.start = std::chrono::steady_clock::now();
+  if (job.snap == nullptr) {
+    job.status = "bad-program";
+    return false;
+  }
+  job.mix = new Mix(*job.snap, DevBackend::MEMORY);
+  bool ok = true;
+  for (auto &d : job.devs) {
+    try {
+      if (job.mix->load_dev(d.first, d.second) < 0)
+        ok = false;
+    } catch (Sys_error &e) {
+      ok = false;
+    }
+  }
+  if (!ok)
+    job.status = "bad-device";
+  return ok;
+}
+
+// Record the result (tick code ret) of job, dump and free it
+void finish_job(Job& job, int ret, std::string out_dir) {
+  if (job.status.empty()) {
+    job.status =
+      (ret == 0) ? "budget" :
+      (ret == TICK_HLT) ? "halt" :
+      "error";
+  }
+  if (job.mix != nullptr) {
+    job.ts = job.mix->get_ts();
+    job.pc = job.mix->get_pc();
+    std::string prefix = out_dir + "/job" + std::to_string(job.id);
+    job.mix->dump(prefix + ".mix");
+    for (auto &d : job.devs) {
+      try {
+        job.mix->dump_dev(d.first, prefix + "." + std::to_string(d.first));
+      } catch (Sys_error &e) {
+        job.status += ",dump-failed";
+      }
+    }
+    delete job.mix;
+    job.mix = nullptr;
+  }
+  auto end = std::chrono::steady_clock::now();
+  job.wall_ms =
+    std::chrono::duration<double, std::milli>(end - job.start).count();
+}
+
+void run_job(Job& job, std::string out_dir) {
+  int ret = 0;
+  if (start_job(job))
+    ret = job.mix->step(job.max_steps);
+  finish_job(job, ret, out_dir);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "Usage: mixbatch <manifest> <out_dir> [threads [slice]]"
+      << std::endl;
+    return 2;
+  }
+  std::string out_dir = argv[2];
+  int nthreads = (argc > 3) ? atoi(argv[3]) : 0;
+  int slice = (argc > 4) ? atoi(argv[4]) : 0;
+
+  std::vector<Job> jobs;
+  if (parse_manifest(argv[1], jobs) < 0)
+    return 1;
+
+  // Snapshot every program in its post-load state
+  std::map<std::string, MixSnapshot *> snaps;
+  for (auto &job : jobs) {
+    if (snaps.count(job.program) == 0 && !std::ifstream(job.program)) {
+      std::cerr << "Cannot open program " << job.program << std::endl;
+      snaps[job.program] = nullptr;
+    }
+    if (snaps.count(job.program) == 0) {
+      std::string path =
+        out_dir + "/prog" + std::to_string(snaps.size()) + ".snap";
+      MixCore core;
+      zero_out(&core, sizeof(MixCore));
+      try {
+        Mix mix(&core, DevBackend::MEMORY);
+        mix.load(job.program);
+        mix.snapshot(path);
+        snaps[job.program] = new MixSnapshot(path);
+      } catch (Sys_error &e) {
+        std::cerr << "Cannot snapshot " << job.program << " to " << path
+          << ", errno = " << e.err << std::endl;
+        return 1;
+      }
+      // Open snapshots stay usable once unlinked
+      std::remove(path.c_str());
+    }
+    job.snap = snaps[job.program];
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  if (slice > 0) {
+    MixScheduler sched(nthreads);
+    nthreads = sched.size();
+    for (auto &job : jobs) {
+      if (!start_job(job)) {
+        finish_job(job, 0, out_dir);
+        continue;
+      }
+      sched.add(run_sliced(job.mix, slice, job.max_steps),
+          [&job, out_dir](int ret) { finish_job(job, ret, out_dir); });
+    }
+    sched.wait();
+  } else {
+    MixPool pool(nthreads);
+    nthreads = pool.size();
+    for (auto &job : jobs)
+      pool.submit([&job, out_dir] { run_job(job, out_dir); });
+    pool.wait();
+  }
+  auto end = std::chrono::steady_clock::now();
+  for (auto &s : snaps)
+    delete s.second;
+  double wall_ms =
+    std::chrono::duration<double, std::milli>(end - start).count();
+
+  // job <id> <program> <status> ts=<ts> pc=<pc> ms=<wall ms>
+  for (auto &job : jobs) {
+    std::cout << "job " << job.id << " " << job.program << " "
+      << job.status << " ts=" << job.ts << " pc=" << job.pc
+      << " ms=" << job.wall_ms << std::endl;
+  }
+  std::cout << "total jobs=" << jobs.size()
+    << " threads=" << nthreads
+    << " ms=" << wall_ms
+    << " jobs/s=" << (wall_ms > 0 ? 1000.0 * jobs.size() / wall_ms : 0)
+    << std::endl;
+  return 0;
+}
@@ -0,0 +1,76 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include "sys.h"
+#include "dbg.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "machine.h"
+#include "multi.h"
+
+/*
+ * Multiprocessor run: <cpus> CPUs execute <program.mix> out of one
+ * shared memory, all starting at pc 0 with I1 set to their number,
+ * until they have all halted, one fails, or the clock passes
+ * <max_ts>. Given a window, the CPUs run on separate threads between
+ * synchronization points (see MixMulti::run_parallel).
+ * The final core is dumped to <out.mix>.
+ *
+ * Exit code: 0 halted, 1 error, 2 usage, 3 out of time (as mix run).
+ */
+constexpr int MP_HALT = 0;
+constexpr int MP_ERROR = 1;
+constexpr int MP_USAGE = 2;
+constexpr int MP_BUDGET = 3;
+
+int main(int argc, char **argv) {
+  if (argc < 5) {
+    std::cout << "Usage: mixmp <program.mix> <cpus> <max_ts> <out.mix>"
+      << " [<window>]" << std::endl;
+    return MP_USAGE;
+  }
+  std::string program = argv[1];
+  int n = atoi(argv[2]);
+  int max_ts = atoi(argv[3]);
+  std::string out_file = argv[4];
+  int window = (argc > 5) ? atoi(argv[5]) : 0;
+  if (n < 1 || max_ts < 0 || window < 0) {
+    std::cout << "Invalid cpus, max_ts or window!" << std::endl;
+    return MP_USAGE;
+  }
+  if (!std::ifstream {program}.is_open()) {
+    std::cerr << "Cannot open " << program << std::endl;
+    return MP_USAGE;
+  }
+
+  MixCore core;
+  zero_out(&core, sizeof(MixCore));
+  load_core(&core, program);
+  MixMulti mp(&core, n);
+  mp.start(0);
+
+  auto start = std::chrono::steady_clock::now();
+  int ret = (window > 0) ? mp.run_parallel(max_ts, window) : mp.run(max_ts);
+  auto end = std::chrono::steady_clock::now();
+  double wall_ms =
+    std::chrono::duration<double, std::milli>(end - start).count();
+
+  // cpu <k> pc=<pc> retired=<n> [halted]
+  for (int k = 0; k < n; k++) {
+    std::cout << "cpu " << k << " pc=" << mp.pc(k)
+      << " retired=" << mp.retired(k)
+      << (mp.halted(k) ? " halted" : "") << std::endl;
+  }
+  std::cout << "total cpus=" << n << " "
+    << (ret == TICK_HLT ? "halt" : ret < 0 ? "error" : "budget")
+    << " ts=" << mp.ts() << " ms=" << wall_ms << std::endl;
+  std::ofstream fs {out_file};
+  fs << core_to_str(&core, true, true, true);
+  fs.close();
+  return (ret == TICK_HLT) ? MP_HALT :
+    (ret == 0) ? MP_BUDGET : MP_ERROR;
+}
@@ -0,0 +1,72 @@
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include "sys.h"
+#include "dbg.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "machine.h"
+#include "lockstep.h"
+
+/*
+ * Parameter sweep: run one program over many data sets in lockstep.
+ *
+ * Every lane starts from <program.mix>, overlaid with its own
+ * <data.mix> (one lane per data file), and starts at pc 0.
+ * The final core of lane k is dumped to <out_dir>/lane<k>.mix.
+ */
+int main(int argc, char **argv) {
+  if (argc < 5) {
+    std::cout << "Usage: mixsweep <program.mix> <max_issues> <out_dir>"
+      << " <data.mix> [<data.mix> ...]" << std::endl;
+    return 2;
+  }
+  std::string program = argv[1];
+  long max_issues = atol(argv[2]);
+  std::string out_dir = argv[3];
+  int n = argc - 4;
+
+  MixLockstep ls(n);
+  MixCore base;
+  zero_out(&base, sizeof(MixCore));
+  load_core(&base, program);
+  for (int k = 0; k < n; k++) {
+    MixCore core = base;
+    load_core(&core, argv[4 + k]);
+    ls.load_lane(k, core);
+  }
+  ls.set_pc(0);
+
+  auto start = std::chrono::steady_clock::now();
+  int running = ls.run(max_issues);
+  auto end = std::chrono::steady_clock::now();
+  double wall_ms =
+    std::chrono::duration<double, std::milli>(end - start).count();
+
+  // lane <k> <data> <status> ts=<ts> pc=<pc>
+  for (int k = 0; k < n; k++) {
+    auto st = ls.state(k);
+    std::cout << "lane " << k << " " << argv[4 + k] << " "
+      << (st == MixLockstep::LaneState::RUN ? "budget" :
+          st == MixLockstep::LaneState::HALT ? "halt" : "error")
+      << " ts=" << ls.ts(k) << " pc=" << ls.pc(k) << std::endl;
+    MixCore core;
+    zero_out(&core, sizeof(MixCore));
+    ls.store_lane(k, core);
+    std::ofstream fs {out_dir + "/lane" + std::to_string(k) + ".mix"};
+    fs << core_to_str(&core, true, true, true);
+  }
+  long issues = ls.get_issues();
+  std::cout << "total lanes=" << n
+    << " running=" << running
+    << " issues=" << issues
+    << " lane_insts=" << ls.get_lane_insts()
+    << " utilization="
+    << (issues > 0 ? (double) ls.get_lane_insts() / (issues * n) : 0)
+    << " ms=" << wall_ms << std::endl;
+  return 0;
+}
@@ -0,0 +1,134 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <unistd.h>
+#include "sys.h"
+#include "core.h"
+#include "status.h"
+
+/*
+ * mixtop: watch a running machine from another process.
+ *
+ * Maps the machine's core file read only, and every interval shows
+ * its state from the status header (see status.h): run state (or
+ * "stale" if it can't be read), pc, MIX time, instructions retired,
+ * throughput over the interval, and the hottest addresses. The
+ * machine never waits for us.
+ *
+ * Usage: mixtop [core_file] [interval_ms] [iterations]
+ * (defaults: ./dev/core, 1000, until the machine exits)
+ */
+
+constexpr int TOP_N = 10;
+
+const char *state_name(RunState state) {
+  switch (state) {
+    case RunState::IDLE: return "idle";
+    case RunState::RUNNING: return "running";
+    case RunState::HALTED: return "halted";
+    case RunState::ERROR: return "error";
+    case RunState::EXITED: return "exited";
+  }
+  return "?";
+}
+
+int main(int argc, char **argv) {
+  std::string core_file = (argc > 1) ? argv[1] : "./dev/core";
+  int interval_ms = (argc > 2) ? atoi(argv[2]) : 1000;
+  int iterations = (argc > 3) ? atoi(argv[3]) : 0;
+  if (interval_ms <= 0) {
+    std::cout << "Usage: mixtop [core_file] [interval_ms] [iterations]"
+      << std::endl;
+    return 2;
+  }
+
+  void *map = nullptr;
+  int fd = -1;
+  try {
+    map_shared_read(core_file, CORE_MAP_SIZE, map, fd);
+  } catch (Sys_error &e) {
+    std::cerr << "Cannot map " << core_file << " (no machine status?), "
+      << "errno = " << e.err << std::endl;
+    return 1;
+  }
+  const MixCore *core = (const MixCore *) map;
+  const MixStatus *st = (const MixStatus *) ((char *) map + STATUS_OFF);
+  if (st->magic != STATUS_MAGIC) {
+    std::cerr << core_file << " has no machine status" << std::endl;
+    unmap_and_close(map, CORE_MAP_SIZE, fd);
+    return 1;
+  }
+
+  bool tty = isatty(STDOUT_FILENO);
+  std::vector<uint32_t> hot(MEM_SIZE), prev_hot(MEM_SIZE);
+  // (zeros if the machine never published anything readable)
+  MixStatusView prev {};
+  status_read(st, prev);
+  MixStatusView view = prev;
+  for (int k = 0; k < MEM_SIZE; k++)
+    prev_hot[k] = st->hot[k].load(std::memory_order_relaxed);
+  auto prev_time = std::chrono::steady_clock::now();
+
+  for (int it = 0; iterations <= 0 || it < iterations; it++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    // Stale: the machine is stuck in (or died during) an update, so
+    // show the last state we got
+    bool stale = status_read(st, view) < 0;
+    for (int k = 0; k < MEM_SIZE; k++)
+      hot[k] = st->hot[k].load(std::memory_order_relaxed);
+    auto now = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(now - prev_time).count();
+
+    // Hottest addresses over the interval
+    std::vector<std::pair<uint32_t, int>> top;
+    uint64_t total = 0;
+    for (int k = 0; k < MEM_SIZE; k++) {
+      // (a restarted machine resets its counters)
+      uint32_t d = (hot[k] >= prev_hot[k]) ? hot[k] - prev_hot[k] : hot[k];
+      if (d > 0)
+        top.push_back({d, k});
+      total += d;
+    }
+    int n = std::min((int) top.size(), TOP_N);
+    std::partial_sort(top.begin(), top.begin() + n, top.end(),
+        [](auto &x, auto &y) { return x.first > y.first; });
+    uint64_t insts = (view.retired >= prev.retired) ?
+      view.retired - prev.retired : view.retired;
+    long mix_time = (view.ts >= prev.ts) ? view.ts - prev.ts : view.ts;
+
+    if (tty)
+      std::cout << "\033[H\033[2J";
+    std::cout << core_file << "  state "
+      << (stale ? "stale" : state_name(view.state))
+      << "  pc " << view.pc << "  ts " << view.ts
+      << "  retired " << view.retired << std::endl;
+    std::cout << std::fixed << std::setprecision(0)
+      << "inst/s " << insts / secs << "  u/s " << mix_time / secs
+      << std::endl << std::endl;
+    std::cout << "  addr      count   share  word" << std::endl;
+    for (int k = 0; k < n; k++) {
+      std::cout << "  " << std::setw(4) << std::setfill('0') << top[k].second
+        << std::setfill(' ') << std::setw(11) << top[k].first
+        << std::setw(7) << std::setprecision(1)
+        << 100.0 * top[k].first / total << "%  "
+        << core->memory[top[k].second] << std::endl;
+    }
+    if (!tty)
+      std::cout << std::endl;
+    std::cout.flush();
+
+    prev = view;
+    prev_hot.swap(hot);
+    prev_time = now;
+    if (view.state == RunState::EXITED)
+      break;
+  }
+  unmap_and_close(map, CORE_MAP_SIZE, fd);
+  return 0;
+}
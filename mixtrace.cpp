@@ -0,0 +1,63 @@
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include "sys.h"
+#include "dbg.h"
+#include "core.h"
+#include "ring.h"
+#include "trace.h"
+
+/*
+ * mixtrace: print a binary execution trace (see trace.h) as text,
+ * one instruction per line:
+ *   <ts> <pc> <instruction word> [M=<addr>] [<dest>=<value>]
+ *
+ * Usage: mixtrace <trace_file>
+ */
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cout << "Usage: mixtrace <trace_file>" << std::endl;
+    return 2;
+  }
+  std::vector<char> in;
+  try {
+    read_file(argv[1], in);
+  } catch (Sys_error &e) {
+    std::cerr << "Cannot read " << argv[1] << ", errno = " << e.err
+      << std::endl;
+    return 1;
+  }
+  size_t i = 0;
+  if (!trace_check_header(in, i)) {
+    std::cerr << argv[1] << " isn't a trace (of this version)"
+      << std::endl;
+    return 1;
+  }
+  TraceCodec codec;
+  TraceRec r;
+  long n = 0;
+  while (i < in.size()) {
+    if (!codec.decode(in, i, r)) {
+      std::cerr << "Truncated trace after " << n << " instructions"
+        << std::endl;
+      return 1;
+    }
+    std::cout << std::setw(8) << std::setfill(' ') << r.ts << " "
+      << std::setw(4) << std::setfill('0') << r.pc << "  " << r.inst;
+    if (r.addr >= 0)
+      std::cout << "  M=" << std::setw(4) << std::setfill('0') << r.addr;
+    if (r.dest == TRACE_MEM)
+      std::cout << "  mem=" << Word(r.value);
+    else if (r.dest != TRACE_NONE)
+      std::cout << "  " << reg_name(r.dest) << "=" << Word(r.value);
+    std::cout << std::endl;
+    n++;
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+#include <vector>
+#include <string>
+#include <atomic>
+#include <algorithm>
+#include "dbg.h"
+#include "sys.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "pool.h"
+#include "multi.h"
+
+MixMulti::MixMulti(MixCore *core, int n, DevBackend backend)
+  : n(n), core(core), cores(n - 1) {
+  LOG_INFO(clock, "Initializing multiprocessor, num = ", n);
+  io = new MixIO(core, backend);
+  for (int k = 0; k < n; k++) {
+    if (k > 0)
+      zero_out(&cores[k - 1], sizeof(MixCore));
+    cpus.push_back(new MixCPU(regs(k), core->memory));
+    if (k == 0)
+      clock = new MixClock(cpus[0], io);
+    else
+      clock->add_cpu(cpus[k]);
+    alone.push_back(new MixClock(cpus[k], io));
+  }
+  for (auto cpu : cpus) {
+    cpu->init(clock, io);
+    cpu->set_multi(true);
+  }
+  io->init(clock);
+}
+
+MixMulti::~MixMulti() {
+  if (pool != nullptr)
+    delete pool;
+  for (auto c : alone)
+    delete c;
+  delete clock;
+  delete io;
+  for (auto cpu : cpus)
+    delete cpu;
+}
+
+void MixMulti::start(int pc) {
+  clock->resume();
+  for (int k = 0; k < n; k++) {
+    regs(k)->i[0] = k;
+    cpus[k]->set_pc(pc);
+    cpus[k]->set_previous_ts(clock->ts());
+  }
+}
+
+int MixMulti::run(int max_ts) {
+  if (clock->all_halted())
+    return TICK_HLT;
+  int next_ts;
+  while ((next_ts = clock->next_ts()) <= max_ts) {
+    int ret = clock->tick_at(next_ts);
+    if (ret < 0)
+      return ret;
+  }
+  return 0;
+}
+
+// Instructions that only run in clock order (see header)
+static bool syncs(Word w) {
+  int c = w.b(5);
+  return (c == 5 && w.b(4) >= 2) || // HLT, XCHA
+    (c >= 34 && c <= 38); // I/O
+}
+
+int MixMulti::run_alone(int k, int horizon) {
+  MixCPU *cpu = cpus[k];
+  MixClock *own = alone[k];
+  own->set_ts(clock->ts());
+  cpu->init(own, io);
+  int failed = -1;
+  while (!syncs(core->memory[cpu->get_pc()])) {
+    int ts = cpu->next_ts();
+    if (ts > horizon)
+      break;
+    own->set_ts(ts);
+    if (cpu->tick() < 0) {
+      failed = ts;
+      break;
+    }
+  }
+  cpu->init(clock, io);
+  return failed;
+}
+
+int MixMulti::run_parallel(int max_ts, int window) {
+  if (pool == nullptr)
+    pool = new MixPool(n);
+  int from = clock->ts();
+  while (clock->next_ts() <= max_ts) {
+    int horizon = std::min({from + window, max_ts, io->next_ts() - 1});
+    if (horizon > from) {
+      std::atomic<int> failed {-1};
+      for (int k = 0; k < n; k++) {
+        if (clock->is_halted(k))
+          continue;
+        pool->submit([this, k, horizon, &failed] {
+          int ts = run_alone(k, horizon);
+          // keep the earliest failure
+          int prev = failed;
+          while (ts >= 0 && (prev < 0 || ts < prev) &&
+              !failed.compare_exchange_weak(prev, ts)) {}
+        });
+      }
+      pool->wait();
+      if (failed >= 0) {
+        LOG_WARN(clock, "CPU failed running alone at ts", (int) failed);
+        clock->set_ts(std::max(clock->ts(), (int) failed));
+        return TICK_ERR;
+      }
+    } else {
+      // An I/O event is due: only clock order until then
+      horizon = clock->next_ts();
+    }
+    int ret = run(horizon);
+    if (ret < 0)
+      return ret;
+    // The CPUs are all past horizon by now, even if none of them
+    // ticked the shared clock
+    clock->set_ts(std::max(clock->ts(), horizon));
+    from = horizon;
+  }
+  return 0;
+}
+
+int MixMulti::ts() {
+  return clock->ts();
+}
+
+int MixMulti::pc(int k) {
+  return cpus[k]->get_pc();
+}
+
+bool MixMulti::halted(int k) {
+  return clock->is_halted(k);
+}
+
+uint64_t MixMulti::retired(int k) {
+  return cpus[k]->get_retired();
+}
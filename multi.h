@@ -0,0 +1,79 @@
+#include <vector>
+#include <cstdint>
+
+class MixPool;
+
+/*
+ * Multiprocessor MIX: n CPUs sharing one memory (the core's) and one
+ * set of devices, driven by one clock (see MixClock).
+ *
+ * CPU 0 uses the registers of the core, every other CPU has its own
+ * (zeroed). Within a clock tick the CPUs execute in order of number,
+ * so a run is deterministic. XCHA (C=5, F=3) exchanges A with M in a
+ * single step, which is enough to synchronize, eg. a spin lock:
+ *   LOCK  ENTA 1
+ *         XCHA MUTEX
+ *         JANZ LOCK
+ *         ...              critical section
+ *         ENTA 0
+ *         XCHA MUTEX
+ *
+ * run_parallel runs each CPU on its own host thread between
+ * synchronization points: it lets every CPU run alone up to its next
+ * XCHA, HLT or I/O instruction, or the end of a window of MIX time,
+ * or the next I/O event, then finishes the window in clock order
+ * (like run) on one thread. A program gets the same result both ways
+ * if its CPUs only share words through XCHA (and data guarded by
+ * it). Ordinary loads and stores racing on the same word are ordered
+ * by the clock in run, but not in run_parallel: there they are a
+ * data race between host threads (undefined behavior, in C++ terms),
+ * so run_parallel is only for programs that synchronize properly.
+ *
+ * XCHA is only enabled on the CPUs of a MixMulti (see
+ * MixCPU::set_multi); a single CPU fails on it.
+ */
+class MixMulti {
+public:
+  // core is shared by every CPU (owned by caller)
+  MixMulti(MixCore *core, int n, DevBackend backend = DevBackend::FILE);
+  ~MixMulti();
+  MixMulti(const MixMulti&) = delete;
+  MixMulti& operator=(const MixMulti&) = delete;
+  int size() { return n; }
+  // Registers of CPU k (CPU 0's are the core's)
+  MixCore *regs(int k) { return (k == 0) ? core : &cores[k - 1]; }
+  // Start every CPU at pc, with I1 set to its number
+  void start(int pc);
+  /*
+   * Run in clock order until every CPU has halted, one failed, or
+   * the clock would pass max_ts. Return TICK_HLT, TICK_ERR, or 0 if
+   * the budget ran out. Halted CPUs stay halted until start().
+   */
+  int run(int max_ts);
+  /*
+   * The same, with the CPUs on separate threads between
+   * synchronization points, window u of MIX time at most (see
+   * above). A CPU failing while running alone stops the run at the
+   * end of that stretch.
+   */
+  int run_parallel(int max_ts, int window);
+
+  int ts();
+  int pc(int k);
+  bool halted(int k);
+  uint64_t retired(int k);
+private:
+  int n;
+  MixCore *core;
+  std::vector<MixCore> cores;
+  std::vector<MixCPU *> cpus;
+  MixIO *io = nullptr;
+  MixClock *clock = nullptr;
+  // per CPU clocks, for running alone (only their ts is used)
+  std::vector<MixClock *> alone;
+  // threads for run_parallel, only allocated once used
+  MixPool *pool = nullptr;
+  // run CPU k alone until its next synchronization point, or past
+  // horizon. Return the ts it failed at, or -1.
+  int run_alone(int k, int horizon);
+};
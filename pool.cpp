@@ -0,0 +1,101 @@
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include "dbg.h"
+#include "pool.h"
+
+MixPool::MixPool(int nthreads) {
+  if (nthreads <= 0)
+    nthreads = (int) std::thread::hardware_concurrency();
+  if (nthreads <= 0)
+    nthreads = 1;
+  LOG_INFO(mix, "Starting worker threads, num = ", nthreads);
+  for (int i = 0; i < nthreads; i++)
+    queues.push_back(new Queue());
+  for (int i = 0; i < nthreads; i++)
+    workers.emplace_back(&MixPool::work, this, i);
+}
+
+MixPool::~MixPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lk(idle_mtx);
+    stopping = true;
+  }
+  idle_cv.notify_all();
+  for (auto &t : workers)
+    t.join();
+  for (auto q : queues)
+    delete q;
+}
+
+void MixPool::submit(std::function<void()> job) {
+  pending++;
+  Queue *q = queues[next_queue++ % queues.size()];
+  {
+    std::lock_guard<std::mutex> lk(q->mtx);
+    q->jobs.push_back(std::move(job));
+  }
+  // Lock so a worker can't miss the wakeup between its last
+  // (empty) scan and going to sleep
+  std::lock_guard<std::mutex> lk(idle_mtx);
+  idle_cv.notify_one();
+}
+
+void MixPool::wait() {
+  std::unique_lock<std::mutex> lk(idle_mtx);
+  done_cv.wait(lk, [this] { return pending == 0; });
+}
+
+bool MixPool::take(int self, std::function<void()>& job) {
+  int n = (int) queues.size();
+  // Own queue first (newest job), then steal (oldest job)
+  for (int k = 0; k < n; k++) {
+    Queue *q = queues[(self + k) % n];
+    std::lock_guard<std::mutex> lk(q->mtx);
+    if (q->jobs.empty())
+      continue;
+    if (k == 0) {
+      job = std::move(q->jobs.back());
+      q->jobs.pop_back();
+    } else {
+      job = std::move(q->jobs.front());
+      q->jobs.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+void MixPool::work(int self) {
+  std::function<void()> job;
+  while (true) {
+    if (take(self, job)) {
+      job();
+      job = nullptr;
+      if (--pending == 0) {
+        std::lock_guard<std::mutex> lk(idle_mtx);
+        done_cv.notify_all();
+      }
+      continue;
+    }
+    std::unique_lock<std::mutex> lk(idle_mtx);
+    if (stopping)
+      return;
+    // Re-check under the lock (submit notifies under it too)
+    idle_cv.wait(lk, [&] {
+      if (stopping)
+        return true;
+      for (auto q : queues) {
+        std::lock_guard<std::mutex> qlk(q->mtx);
+        if (!q->jobs.empty())
+          return true;
+      }
+      return false;
+    });
+  }
+}
@@ -0,0 +1,43 @@
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+/*
+ * Work-stealing thread pool.
+ *
+ * Each worker has its own deque of jobs. Submitted jobs are spread
+ * round-robin over the workers. A worker runs jobs from the back of
+ * its own deque, and when that's empty steals from the front of the
+ * others, so uneven job lengths still keep every thread busy.
+ */
+class MixPool {
+public:
+  // nthreads <= 0 -> one per hardware thread
+  MixPool(int nthreads = 0);
+  ~MixPool();
+  void submit(std::function<void()> job);
+  // Wait until every submitted job has finished
+  void wait();
+  int size() { return (int) workers.size(); }
+private:
+  struct Queue {
+    std::mutex mtx;
+    std::deque<std::function<void()>> jobs;
+  };
+  std::vector<std::thread> workers;
+  std::vector<Queue *> queues;
+  // jobs submitted but not finished
+  std::atomic<long> pending {0};
+  std::atomic<bool> stopping {false};
+  std::atomic<unsigned> next_queue {0};
+  // sleeping workers wait on this when there's nothing to steal
+  std::mutex idle_mtx;
+  std::condition_variable idle_cv;
+  std::condition_variable done_cv;
+  bool take(int self, std::function<void()>& job);
+  void work(int self);
+};
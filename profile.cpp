@@ -0,0 +1,183 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <cstdint>
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "profile.h"
+#include "srcmap.h"
+
+std::string profile_to_str(const MixProfile& p, const MixCore *core,
+    int top_n) {
+  std::vector<int> addrs;
+  uint64_t total_count = 0;
+  uint64_t total_time = 0;
+  for (int k = 0; k < MEM_SIZE; k++) {
+    if (p.count[k] > 0)
+      addrs.push_back(k);
+    total_count += p.count[k];
+    total_time += p.time[k];
+  }
+  int n = std::clamp(top_n, 0, (int) addrs.size());
+  std::partial_sort(addrs.begin(), addrs.begin() + n, addrs.end(),
+      [&p](int x, int y) {
+        return (p.time[x] != p.time[y]) ? p.time[x] > p.time[y] : x < y;
+      });
+
+  std::ostringstream out;
+  out << "addr        count         time   time%  word" << std::endl;
+  for (int k = 0; k < n; k++) {
+    int a = addrs[k];
+    out << std::setw(4) << std::setfill('0') << a << std::setfill(' ')
+      << std::setw(13) << p.count[a] << std::setw(13) << p.time[a]
+      << std::fixed << std::setprecision(1) << std::setw(7)
+      << ((total_time > 0) ? 100.0 * p.time[a] / total_time : 0.0)
+      << "%  " << core->memory[a] << std::endl;
+  }
+  out << std::setfill(' ') << "total" << std::setw(12) << total_count
+    << std::setw(13) << total_time << "  (" << addrs.size()
+    << " addresses)";
+  return out.str();
+}
+
+std::string profile_dump(const MixProfile& p, const MixCore *core) {
+  std::ostringstream out;
+  for (int k = 0; k < MEM_SIZE; k++) {
+    if (p.count[k] == 0)
+      continue;
+    out << std::setw(4) << std::setfill('0') << k << std::setfill(' ')
+      << ": " << core->memory[k] << "  # " << p.count[k] << " "
+      << p.time[k] << std::endl;
+  }
+  return out.str();
+}
+
+MixCallGraph::MixCallGraph(const MixCore *core) : core(core) {
+  nodes.emplace_back(-1, -1);
+  stack.push_back({0, -1});
+}
+
+int MixCallGraph::child(int node, int func) {
+  for (int c : nodes[node].children) {
+    if (nodes[c].func == func)
+      return c;
+  }
+  nodes.emplace_back(func, node);
+  int c = (int) nodes.size() - 1;
+  nodes[node].children.push_back(c);
+  return c;
+}
+
+void MixCallGraph::step(int pc, const MixInst& in, int next_pc,
+    int time) {
+  nodes[stack.back().node].self += time;
+  if (next_pc < 0 || next_pc == pc + 1)
+    return;
+  // Taken jump that set rJ, landing on STJ: call
+  bool sets_j = (in.c == 34 || in.c == 38 || in.c == 39 ||
+      (in.c >= 40 && in.c < 48)) && !(in.c == 39 && in.f == 1);
+  if (sets_j && core->memory[next_pc].b(5) == 32 &&
+      stack.size() < MAX_DEPTH) {
+    int c = child(stack.back().node, next_pc);
+    nodes[c].calls++;
+    stack.push_back({c, pc + 1});
+    return;
+  }
+  // Jump back to where a call on the stack returns: return
+  for (size_t k = stack.size() - 1; k > 0; k--) {
+    if (stack[k].ret == next_pc) {
+      stack.resize(k);
+      return;
+    }
+  }
+}
+
+uint64_t MixCallGraph::total(int node) {
+  uint64_t t = nodes[node].self;
+  for (int c : nodes[node].children)
+    t += total(c);
+  return t;
+}
+
+static std::string func_name(int func,
+    const MixSourceMap *map = nullptr) {
+  if (func < 0)
+    return "start";
+  if (map != nullptr)
+    return map->symbol(func);
+  std::ostringstream out;
+  out << std::setw(4) << std::setfill('0') << func;
+  return out.str();
+}
+
+std::string MixCallGraph::path(int node, const MixSourceMap *map) {
+  if (nodes[node].parent < 0)
+    return func_name(nodes[node].func, map);
+  return path(nodes[node].parent, map) + ";" +
+    func_name(nodes[node].func, map);
+}
+
+std::string MixCallGraph::to_str(const MixSourceMap *map) {
+  struct Sum {
+    uint64_t calls = 0;
+    uint64_t incl = 0;
+    uint64_t excl = 0;
+  };
+  std::map<int, Sum> funcs;
+  std::map<std::pair<int, int>, Sum> edges;
+  // Walk the tree, counting a subtree towards a subroutine's
+  // inclusive time only at its outermost (non recursive) call
+  std::vector<int> on_path(MEM_SIZE + 1, 0);
+  std::function<void(int)> walk = [&](int node) {
+    Node& n = nodes[node];
+    Sum& f = funcs[n.func];
+    f.calls += n.calls;
+    f.excl += n.self;
+    uint64_t t = total(node);
+    if (on_path[n.func + 1]++ == 0)
+      f.incl += t;
+    if (n.parent >= 0) {
+      Sum& e = edges[{nodes[n.parent].func, n.func}];
+      e.calls += n.calls;
+      e.incl += t;
+    }
+    for (int c : n.children)
+      walk(c);
+    on_path[n.func + 1]--;
+  };
+  walk(0);
+
+  std::vector<std::pair<int, Sum>> sorted(funcs.begin(), funcs.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+      [](auto& x, auto& y) { return x.second.incl > y.second.incl; });
+  std::ostringstream out;
+  out << "subroutine      calls    inclusive    exclusive";
+  for (auto& [func, f] : sorted) {
+    out << std::endl << std::left << std::setw(10) << func_name(func, map)
+      << std::right << std::setfill(' ') << std::setw(11) << f.calls
+      << std::setw(13) << f.incl << std::setw(13) << f.excl;
+  }
+  out << std::endl << std::endl << "caller -> callee      calls    inclusive";
+  for (auto& [edge, e] : edges) {
+    out << std::endl << std::left << std::setw(6)
+      << func_name(edge.first, map) << "-> " << std::setw(9)
+      << func_name(edge.second, map)
+      << std::right << std::setfill(' ') << std::setw(9) << e.calls
+      << std::setw(13) << e.incl;
+  }
+  return out.str();
+}
+
+std::string MixCallGraph::folded(const MixSourceMap *map) {
+  std::ostringstream out;
+  for (size_t k = 0; k < nodes.size(); k++) {
+    if (nodes[k].self > 0)
+      out << path((int) k, map) << " " << nodes[k].self << std::endl;
+  }
+  return out.str();
+}
@@ -0,0 +1,98 @@
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Frequency-count profile, in the style of Knuth's program analyses:
+ * how many times the instruction at each address was executed, and
+ * the MIX time (u) it took. An instruction's time runs from the
+ * previous instruction to its completion (see MixCPU::get_ts), so
+ * waits for I/O devices are charged to the instruction that waited.
+ *
+ * Collected by MixCPU::tick while set (see Mix::profile).
+ */
+struct MixProfile {
+  uint64_t count[MEM_SIZE] = {};
+  uint64_t time[MEM_SIZE] = {};
+};
+
+/*
+ * Hot spots: the top_n addresses that took the most time, with their
+ * count, time, share of the total time and the word there, followed
+ * by the totals (only the totals if top_n <= 0).
+ */
+std::string profile_to_str(const MixProfile& p, const MixCore *core,
+    int top_n);
+
+/*
+ * Annotated dump: every executed address as a core dump line (see
+ * core_to_str), followed by its count and time:
+ *   0003: + 00 00 00 02 05  # 12 24
+ * Not meant to be loaded back.
+ */
+std::string profile_dump(const MixProfile& p, const MixCore *core);
+
+/*
+ * Call graph profile, inferred from the MIX subroutine linkage
+ * convention (see test/max.mixal): the caller jumps to the
+ * subroutine, which starts by saving rJ with STJ EXIT, and returns
+ * with the EXIT JMP * it patched.
+ *
+ * So a taken jump that sets rJ (any but JSJ) and lands on an STJ is
+ * a call, returning to rJ (the address after the jump). A jump to the
+ * return address of a call still on the shadow stack returns from it
+ * (and from anything it called that didn't return normally).
+ * Subroutines that don't start with STJ aren't seen as calls: their
+ * time goes to their caller.
+ *
+ * The time of every instruction (as in MixProfile) goes to the call
+ * path it ran in, building a calling context tree, from which the
+ * per subroutine inclusive/exclusive times and the call edges are
+ * derived. Time outside of any call goes to "start".
+ */
+struct MixInst;
+class MixSourceMap;
+
+class MixCallGraph {
+public:
+  MixCallGraph(const MixCore *core);
+  // Called by MixCPU::tick for each instruction: executed at pc,
+  // took time u, and continues at next_pc (negative if it stopped)
+  void step(int pc, const MixInst& in, int next_pc, int time);
+  /*
+   * Report: every subroutine (by entry address) with its calls,
+   * inclusive and exclusive time, sorted by inclusive time, then
+   * every call edge with its calls and inclusive time.
+   * Subroutines are named by their symbol in map, if given.
+   */
+  std::string to_str(const MixSourceMap *map = nullptr);
+  /*
+   * Folded stacks, for flame graph tools: one line per call path
+   * with its exclusive time, eg.
+   *   start;3000 46
+   */
+  std::string folded(const MixSourceMap *map = nullptr);
+private:
+  // Calls nested deeper than this are treated as plain jumps
+  static constexpr size_t MAX_DEPTH = 1024;
+  // A node of the calling context tree
+  struct Node {
+    Node(int func, int parent) : func(func), parent(parent) {}
+    int func;
+    int parent;
+    uint64_t calls = 0;
+    uint64_t self = 0;
+    std::vector<int> children;
+  };
+  struct Frame {
+    int node;
+    int ret;
+  };
+  const MixCore *core;
+  std::vector<Node> nodes;
+  std::vector<Frame> stack;
+  int child(int node, int func);
+  // time of the subtree at node
+  uint64_t total(int node);
+  std::string path(int node, const MixSourceMap *map);
+};
@@ -0,0 +1,41 @@
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Lock-free single producer, single consumer ring buffer of
+ * N (a power of 2) elements of type T.
+ *
+ * Exactly one thread may push and exactly one (other) thread may pop.
+ * Neither side ever blocks: push fails when the ring is full, and
+ * pop fails when it's empty.
+ */
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of 2");
+public:
+  bool push(const T& v) {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) == N)
+      return false;
+    buf[h & (N - 1)] = v;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+  bool pop(T& v) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire))
+      return false;
+    v = buf[t & (N - 1)];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+  bool empty() {
+    return tail.load(std::memory_order_acquire) ==
+      head.load(std::memory_order_acquire);
+  }
+private:
+  // Keep the producer and consumer indices on separate cache lines
+  alignas(64) std::atomic<size_t> head {0};
+  alignas(64) std::atomic<size_t> tail {0};
+  T buf[N];
+};
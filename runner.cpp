@@ -0,0 +1,96 @@
+#include <vector>
+#include <string>
+#include <atomic>
+#include <thread>
+#include "dbg.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "machine.h"
+#include "ring.h"
+#include "runner.h"
+
+MixRunner::MixRunner(Mix *mix, int quantum)
+  : mix(mix), quantum(quantum), worker(&MixRunner::work, this) {}
+
+MixRunner::~MixRunner() {
+  send(Cmd::QUIT);
+  worker.join();
+}
+
+void MixRunner::send(Cmd c) {
+  // Only full if the worker is stuck in a slice, wait for it
+  while (!cmds.push(c))
+    std::this_thread::yield();
+  kick++;
+  kick.notify_one();
+}
+
+void MixRunner::resume() {
+  LOG_INFO(mix, "Resuming background run");
+  // Set here (not by the worker), so a wait() right after this
+  // doesn't see the old state
+  st = State::RUNNING;
+  send(Cmd::RESUME);
+}
+
+void MixRunner::pause() {
+  LOG_INFO(mix, "Pausing background run");
+  send(Cmd::PAUSE);
+  wait();
+}
+
+MixRunner::State MixRunner::wait() {
+  st.wait(State::RUNNING);
+  return st.load();
+}
+
+void MixRunner::inspect(MixCore *core, int& pc, int& ts) {
+  inspect_core = core;
+  unsigned seen = inspected.load();
+  send(Cmd::INSPECT);
+  inspected.wait(seen);
+  pc = inspect_pc;
+  ts = inspect_ts;
+}
+
+void MixRunner::work() {
+  bool running = false;
+  while (true) {
+    unsigned seen = kick.load();
+    Cmd c;
+    while (cmds.pop(c)) {
+      if (c == Cmd::RESUME) {
+        running = true;
+      } else if (c == Cmd::PAUSE) {
+        if (running) {
+          running = false;
+          ret = 0;
+          st = State::PAUSED;
+          st.notify_all();
+        }
+      } else if (c == Cmd::INSPECT) {
+        *inspect_core = *mix->get_core();
+        inspect_pc = mix->get_pc();
+        inspect_ts = mix->get_ts();
+        inspected++;
+        inspected.notify_all();
+      } else {
+        return;
+      }
+    }
+    if (!running) {
+      kick.wait(seen);
+      continue;
+    }
+    int r = mix->step(quantum);
+    if (r < 0) {
+      LOG_INFO(mix, "Background run stopped, code ", r);
+      running = false;
+      ret = r;
+      st = (r == TICK_BRK) ? State::PAUSED : State::STOPPED;
+      st.notify_all();
+    }
+  }
+}
@@ -0,0 +1,67 @@
+#include <atomic>
+#include <thread>
+
+class Mix;
+struct MixCore;
+
+/*
+ * Runs a machine on a background worker thread.
+ *
+ * The controlling thread sends commands to the worker through a
+ * lock-free queue (see ring.h). The worker runs the machine in slices
+ * of quantum steps, and handles commands in between, so a command
+ * waits at most one slice. An idle worker sleeps until the next
+ * command.
+ *
+ * Only one thread may control a runner. While it's RUNNING, only the
+ * worker may touch the machine: read it through inspect(). Once the
+ * runner is no longer RUNNING (eg. after pause() or wait() return),
+ * the controlling thread may use the machine directly, until the next
+ * resume().
+ *
+ * A SIGINT handler can pause the run with Mix::interrupt().
+ */
+class MixRunner {
+public:
+  enum class State { PAUSED, RUNNING, STOPPED };
+
+  MixRunner(Mix *mix, int quantum = 10000);
+  // Pauses the run and stops the worker
+  ~MixRunner();
+  // Start/continue running in the background
+  void resume();
+  // Pause, and wait until the worker has paused
+  void pause();
+  // Wait until the run pauses or stops by itself
+  State wait();
+  /*
+   * PAUSED -> paused by pause(), a breakpoint, or Mix::interrupt()
+   * STOPPED -> halted or failed
+   */
+  State state() { return st.load(); }
+  // Tick code the run last stopped with (0 if paused by pause())
+  int result() { return ret.load(); }
+  /*
+   * Copy the core, pc and clock ts of the machine, as of the end of
+   * a slice. The running machine only pays for the copy.
+   */
+  void inspect(MixCore *core, int& pc, int& ts);
+private:
+  enum class Cmd { RESUME, PAUSE, INSPECT, QUIT };
+  Mix *mix;
+  int quantum;
+  // Commands are pushed by the controlling thread only
+  SpscRing<Cmd, 16> cmds;
+  // bumped (and notified) with every command, to wake the worker
+  std::atomic<unsigned> kick {0};
+  std::atomic<State> st {State::PAUSED};
+  std::atomic<int> ret {0};
+  // inspect() request/response
+  MixCore *inspect_core = nullptr;
+  int inspect_pc = 0;
+  int inspect_ts = 0;
+  std::atomic<unsigned> inspected {0};
+  std::thread worker;
+  void send(Cmd c);
+  void work();
+};
@@ -0,0 +1,115 @@
+#include <coroutine>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include "dbg.h"
+#include "core.h"
+#include "io.h"
+#include "cpu.h"
+#include "clock.h"
+#include "machine.h"
+#include "scheduler.h"
+
+MixTask run_sliced(Mix *mix, int quantum, long budget, bool mix_time) {
+  long done = 0;
+  while (budget < 0 || done < budget) {
+    int ret = 0;
+    if (mix_time) {
+      // Whole instructions, until the slice of MIX time is used up
+      int start = mix->get_ts();
+      while (mix->get_ts() - start < quantum &&
+          (budget < 0 || done < budget)) {
+        if ((ret = mix->step(1)) < 0)
+          break;
+        done++;
+      }
+    } else {
+      long ct = quantum;
+      if (budget >= 0 && budget - done < ct)
+        ct = budget - done;
+      ret = mix->step((int) ct);
+      done += ct;
+    }
+    if (ret < 0)
+      co_return ret;
+    co_await std::suspend_always{};
+  }
+  co_return 0;
+}
+
+MixScheduler::MixScheduler(int nthreads) {
+  if (nthreads <= 0)
+    nthreads = (int) std::thread::hardware_concurrency();
+  if (nthreads <= 0)
+    nthreads = 1;
+  LOG_INFO(mix, "Starting scheduler threads, num = ", nthreads);
+  for (int i = 0; i < nthreads; i++)
+    workers.push_back(new Worker());
+  for (int i = 0; i < nthreads; i++)
+    threads.emplace_back(&MixScheduler::work, this, workers[i]);
+}
+
+MixScheduler::~MixScheduler() {
+  wait();
+  stopping = true;
+  for (auto w : workers) {
+    std::lock_guard<std::mutex> lk(w->mtx);
+    w->cv.notify_all();
+  }
+  for (auto &t : threads)
+    t.join();
+  for (auto w : workers)
+    delete w;
+}
+
+void MixScheduler::add(MixTask task, std::function<void(int)> done) {
+  pending++;
+  Worker *w = workers[next_worker++ % workers.size()];
+  std::lock_guard<std::mutex> lk(w->mtx);
+  w->inbox.push_back(Entry{std::move(task), std::move(done)});
+  w->cv.notify_one();
+}
+
+void MixScheduler::wait() {
+  std::unique_lock<std::mutex> lk(done_mtx);
+  done_cv.wait(lk, [this] { return pending == 0; });
+}
+
+void MixScheduler::work(Worker *w) {
+  std::vector<Entry> tasks;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lk(w->mtx);
+      if (tasks.empty()) {
+        w->cv.wait(lk, [&] { return stopping || !w->inbox.empty(); });
+        if (stopping && w->inbox.empty())
+          return;
+      }
+      for (auto &e : w->inbox)
+        tasks.push_back(std::move(e));
+      w->inbox.clear();
+    }
+
+    // One round: a slice for every task, dropping finished ones
+    size_t live = 0;
+    for (size_t k = 0; k < tasks.size(); k++) {
+      if (!tasks[k].task.resume()) {
+        if (tasks[k].done)
+          tasks[k].done(tasks[k].task.result());
+        if (--pending == 0) {
+          std::lock_guard<std::mutex> lk(done_mtx);
+          done_cv.notify_all();
+        }
+        continue;
+      }
+      if (live != k)
+        tasks[live] = std::move(tasks[k]);
+      live++;
+    }
+    tasks.erase(tasks.begin() + live, tasks.end());
+  }
+}
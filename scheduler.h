@@ -0,0 +1,104 @@
+#include <coroutine>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+class Mix;
+
+/*
+ * A resumable run of a machine (C++20 coroutine).
+ * Starts suspended; every resume() runs one slice, then yields.
+ * Once done, result() is the tick code the machine stopped with
+ * (TICK_HLT, TICK_ERR, ...) or 0 if it used up its budget.
+ */
+class MixTask {
+public:
+  struct promise_type {
+    int result = 0;
+    MixTask get_return_object() {
+      return MixTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_value(int v) { result = v; }
+    // eg. Sys_error from a device
+    void unhandled_exception() { result = TICK_ERR; }
+  };
+
+  MixTask(MixTask&& other) : h(other.h) { other.h = nullptr; }
+  MixTask(const MixTask&) = delete;
+  MixTask& operator=(MixTask&& other) {
+    if (this != &other) {
+      if (h)
+        h.destroy();
+      h = other.h;
+      other.h = nullptr;
+    }
+    return *this;
+  }
+  ~MixTask() {
+    if (h)
+      h.destroy();
+  }
+  // Run one slice. Return false once the run is finished.
+  bool resume() {
+    if (!h.done())
+      h.resume();
+    return !h.done();
+  }
+  bool done() { return h.done(); }
+  int result() { return h.promise().result; }
+private:
+  explicit MixTask(std::coroutine_handle<promise_type> h) : h(h) {}
+  std::coroutine_handle<promise_type> h;
+};
+
+/*
+ * Run mix (not owned) in slices of quantum instructions, or quantum
+ * u of MIX time if mix_time is set, yielding after each slice.
+ * Stop after budget instructions (budget < 0 -> until halt/error).
+ */
+MixTask run_sliced(Mix *mix, int quantum, long budget = -1,
+    bool mix_time = false);
+
+/*
+ * Round-robin scheduler multiplexing many machine runs over a few
+ * OS threads. Each task is pinned to one thread (assigned round-robin
+ * when added), and each thread resumes its tasks one slice at a time.
+ * An idle task costs its machine plus a coroutine frame.
+ */
+class MixScheduler {
+public:
+  // nthreads <= 0 -> one per hardware thread
+  MixScheduler(int nthreads = 0);
+  ~MixScheduler();
+  /*
+   * Schedule task. done (if any) is called with the task's result
+   * on the thread that ran it, once it finishes.
+   */
+  void add(MixTask task, std::function<void(int)> done = nullptr);
+  // Wait until every added task has finished
+  void wait();
+  int size() { return (int) threads.size(); }
+private:
+  struct Entry {
+    MixTask task;
+    std::function<void(int)> done;
+  };
+  struct Worker {
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<Entry> inbox;
+  };
+  std::vector<std::thread> threads;
+  std::vector<Worker *> workers;
+  std::atomic<long> pending {0};
+  std::atomic<bool> stopping {false};
+  std::atomic<unsigned> next_worker {0};
+  std::mutex done_mtx;
+  std::condition_variable done_cv;
+  void work(Worker *w);
+};
@@ -0,0 +1,95 @@
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdint>
+#include "dbg.h"
+#include "core.h"
+#include "profile.h"
+#include "srcmap.h"
+
+int MixSourceMap::load(std::string filename) {
+  LOG_INFO(mix, "loading source map ", filename);
+  std::ifstream fs {filename};
+  if (!fs.is_open())
+    return -1;
+  lines.clear();
+  for (std::string row; getline(fs, row); ) {
+    std::istringstream in {row};
+    int addr;
+    SourceLine src;
+    if (!(in >> addr >> src.line >> src.symbol) ||
+        addr < 0 || addr >= MEM_SIZE)
+      continue;
+    // The source line is everything after the space following symbol
+    in.get();
+    getline(in, src.text);
+    lines[addr] = src;
+  }
+  return 0;
+}
+
+int MixSourceMap::save(std::string filename) const {
+  std::ofstream fs {filename};
+  if (!fs.is_open())
+    return -1;
+  for (auto &[addr, src] : lines) {
+    fs << std::setw(4) << std::setfill('0') << addr << " " << src.line
+      << " " << src.symbol << " " << src.text << std::endl;
+  }
+  return 0;
+}
+
+const SourceLine *MixSourceMap::at(int addr) const {
+  auto it = lines.find(addr);
+  return (it == lines.end()) ? nullptr : &it->second;
+}
+
+std::string MixSourceMap::symbol(int addr) const {
+  const SourceLine *src = at(addr);
+  if (src != nullptr && src->symbol != "-")
+    return src->symbol;
+  std::ostringstream out;
+  out << std::setw(4) << std::setfill('0') << addr;
+  return out.str();
+}
+
+std::string MixSourceMap::listing(const MixProfile& p) const {
+  struct Sum {
+    uint64_t count = 0;
+    uint64_t time = 0;
+  };
+  // line -> (text, totals), several words can share a line
+  std::map<int, std::pair<std::string, Sum>> by_line;
+  std::map<std::string, Sum> by_symbol;
+  for (auto &[addr, src] : lines) {
+    auto &l = by_line[src.line];
+    l.first = src.text;
+    l.second.count += p.count[addr];
+    l.second.time += p.time[addr];
+    Sum &s = by_symbol[src.symbol];
+    s.count += p.count[addr];
+    s.time += p.time[addr];
+  }
+
+  std::ostringstream out;
+  out << "line       count        time  source";
+  for (auto &[line, l] : by_line) {
+    out << std::endl << std::setw(4) << line << std::setw(12)
+      << l.second.count << std::setw(12) << l.second.time << "  "
+      << l.first;
+  }
+  std::vector<std::pair<std::string, Sum>> sorted(
+      by_symbol.begin(), by_symbol.end());
+  std::stable_sort(sorted.begin(), sorted.end(),
+      [](auto &x, auto &y) { return x.second.time > y.second.time; });
+  out << std::endl << std::endl << "symbol         count        time";
+  for (auto &[sym, s] : sorted) {
+    out << std::endl << std::left << std::setw(10) << sym << std::right
+      << std::setw(10) << s.count << std::setw(12) << s.time;
+  }
+  return out.str();
+}
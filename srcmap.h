@@ -0,0 +1,48 @@
+#include <string>
+#include <map>
+
+struct MixProfile;
+
+/*
+ * Source map written by mixal next to its output (<name>.map): the
+ * MIXAL line each word was assembled from. One row per word:
+ *   <addr> <line> <symbol> <source line>
+ * symbol is the last global symbol defined at or before the word
+ * ("-" if none).
+ */
+struct SourceLine {
+  int line;
+  std::string symbol;
+  std::string text;
+};
+
+class MixSourceMap {
+public:
+  /*
+   * Read a source map, replacing anything loaded before. Skip all
+   * invalid rows. Return -1 if the file can't be opened.
+   */
+  int load(std::string filename);
+  /*
+   * Write the map out in the same format (mixal). Return -1 if the
+   * file can't be created.
+   */
+  int save(std::string filename) const;
+  // Record the source of addr, replacing any it had (mixal)
+  void set(int addr, const SourceLine& src) { lines[addr] = src; }
+  bool empty() const { return lines.empty(); }
+  // The source of addr, or nullptr if it has none
+  const SourceLine *at(int addr) const;
+  // The symbol of addr, or addr itself (4 digits) if it has none
+  std::string symbol(int addr) const;
+  /*
+   * Listing of the source lines that were assembled, annotated with
+   * the count and MIX time of their words in profile p, followed by
+   * the total per symbol, hottest first:
+   *   line       count        time  source
+   *      6           5          10  LOOP    CMPA   X,3
+   */
+  std::string listing(const MixProfile& p) const;
+private:
+  std::map<int, SourceLine> lines;
+};
@@ -0,0 +1,93 @@
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <cstdint>
+#include "stats.h"
+
+static const char *class_names[NUM_OP_CLASSES] = {
+  "nop", "arith", "special", "shift", "move", "load", "store", "io",
+  "jump", "transfer", "compare"
+};
+
+static const char *io_names[3] = {"IOC", "IN", "OUT"};
+
+int op_class(int c) {
+  if (c == 0) return 0;
+  if (c <= 4) return 1;
+  if (c == 5) return 2;
+  if (c == 6) return 3;
+  if (c == 7) return 4;
+  if (c < 24) return 5;
+  if (c < 34) return 6;
+  if (c < 39) return 7;
+  if (c < 48) return 8;
+  if (c < 56) return 9;
+  return 10;
+}
+
+const char *op_class_name(int k) {
+  return class_names[k];
+}
+
+static void class_counts(const MixStats& s, uint64_t *counts) {
+  for (int k = 0; k < NUM_OP_CLASSES; k++)
+    counts[k] = 0;
+  for (int c = 0; c < NUM_OPS; c++)
+    counts[op_class(c)] += s.ops[c];
+}
+
+static double ns_per_inst(const MixStats& s) {
+  return (s.retired > 0) ? (double) s.host_ns / s.retired : 0;
+}
+
+static double u_per_sec(const MixStats& s) {
+  return (s.host_ns > 0) ? s.mix_time * 1e9 / s.host_ns : 0;
+}
+
+std::string stats_to_str(const MixStats& s) {
+  uint64_t counts[NUM_OP_CLASSES];
+  class_counts(s, counts);
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1);
+  out << "retired " << s.retired << std::endl;
+  out << "ticks " << s.ticks << " (idle " << s.idle_ticks << ")"
+    << std::endl;
+  out << "mix time " << s.mix_time << " u in " << s.host_ns / 1e6
+    << " ms host time" << std::endl;
+  out << "ns/inst " << ns_per_inst(s) << "  u/s " << u_per_sec(s)
+    << std::endl;
+  out << "io staged";
+  for (int k = 0; k < 3; k++)
+    out << " " << io_names[k] << " " << s.io_staged[k];
+  out << std::endl;
+  out << "retired per class:";
+  for (int k = 0; k < NUM_OP_CLASSES; k++) {
+    out << std::endl << "  " << std::left << std::setw(9) << class_names[k]
+      << std::right << std::setw(12) << counts[k];
+    if (s.retired > 0)
+      out << std::setw(7) << 100.0 * counts[k] / s.retired << "%";
+  }
+  return out.str();
+}
+
+std::string stats_to_json(const MixStats& s) {
+  uint64_t counts[NUM_OP_CLASSES];
+  class_counts(s, counts);
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"retired\": " << s.retired
+    << ", \"ticks\": " << s.ticks
+    << ", \"idle_ticks\": " << s.idle_ticks
+    << ", \"mix_time\": " << s.mix_time
+    << ", \"host_ns\": " << s.host_ns
+    << ", \"ns_per_inst\": " << ns_per_inst(s)
+    << ", \"u_per_sec\": " << u_per_sec(s)
+    << ", \"io_staged\": {";
+  for (int k = 0; k < 3; k++)
+    out << (k ? ", " : "") << "\"" << io_names[k] << "\": " << s.io_staged[k];
+  out << "}, \"op_classes\": {";
+  for (int k = 0; k < NUM_OP_CLASSES; k++)
+    out << (k ? ", " : "") << "\"" << class_names[k] << "\": " << counts[k];
+  out << "}}" << std::endl;
+  return out.str();
+}
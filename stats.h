@@ -0,0 +1,47 @@
+#include <string>
+#include <cstdint>
+
+/*
+ * Performance counters of a machine (see Mix::get_stats), kept since
+ * it was created. They're always on, so each is at most an increment
+ * per instruction or clock tick.
+ *
+ *   ops          instructions retired, per opcode C
+ *   retired      instructions retired
+ *   ticks        clock ticks
+ *   idle_ticks   clock ticks where neither the CPU nor the I/O
+ *                coprocessor did anything
+ *   io_staged    I/O operations staged: IOC, IN, OUT
+ *   host_ns      host (wall) time spent in step/timestep/run
+ *   mix_time     MIX time (u) the clock advanced in them
+ */
+constexpr int NUM_OPS = 64;
+
+struct MixStats {
+  uint64_t ops[NUM_OPS];
+  uint64_t retired;
+  uint64_t ticks;
+  uint64_t idle_ticks;
+  uint64_t io_staged[3];
+  uint64_t host_ns;
+  uint64_t mix_time;
+};
+
+/*
+ * Opcode classes, for reporting: nop, arith, special (NUM, CHAR,
+ * HLT), shift, move, load, store, io (IN, OUT, IOC, JBUS, JRED),
+ * jump, transfer and compare.
+ */
+constexpr int NUM_OP_CLASSES = 11;
+int op_class(int c);
+const char *op_class_name(int k);
+
+/*
+ * Human readable report, and the same as a JSON object:
+ *   {"retired": n, "ticks": n, "idle_ticks": n, "mix_time": n,
+ *    "host_ns": n, "ns_per_inst": x, "u_per_sec": x,
+ *    "io_staged": {"IOC": n, "IN": n, "OUT": n},
+ *    "op_classes": {"nop": n, "arith": n, ...}}
+ */
+std::string stats_to_str(const MixStats& s);
+std::string stats_to_json(const MixStats& s);
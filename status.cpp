@@ -0,0 +1,49 @@
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include "core.h"
+#include "status.h"
+
+// A publish takes a few stores, so a reader that still sees it in
+// progress after this many tries has a writer that died mid-update
+constexpr int STATUS_READ_TRIES = 1000;
+
+MixStatus *status_init(void *addr) {
+  MixStatus *st = new (addr) MixStatus();
+  st->magic = STATUS_MAGIC;
+  return st;
+}
+
+void status_publish(MixStatus *st, int pc, int ts, uint64_t retired,
+    RunState state) {
+  uint32_t seq = st->seq.load(std::memory_order_relaxed);
+  st->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  st->pc.store(pc, std::memory_order_relaxed);
+  st->ts.store(ts, std::memory_order_relaxed);
+  st->retired.store(retired, std::memory_order_relaxed);
+  st->state.store((uint32_t) state, std::memory_order_relaxed);
+  st->seq.store(seq + 2, std::memory_order_release);
+}
+
+int status_read(const MixStatus *st, MixStatusView& view) {
+  for (int tries = 0; tries < STATUS_READ_TRIES; tries++) {
+    uint32_t seq = st->seq.load(std::memory_order_acquire);
+    if (seq % 2 != 0) {
+      std::this_thread::yield();
+      continue;
+    }
+    MixStatusView v;
+    v.pc = st->pc.load(std::memory_order_relaxed);
+    v.ts = st->ts.load(std::memory_order_relaxed);
+    v.retired = st->retired.load(std::memory_order_relaxed);
+    v.state = (RunState) st->state.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (st->seq.load(std::memory_order_relaxed) == seq) {
+      view = v;
+      return 0;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,67 @@
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Live status of a machine, published in its mapped core file (right
+ * after the MixCore, at STATUS_OFF), so other processes (mixtop) can
+ * watch it run without slowing it down.
+ *
+ * pc, ts, retired and state are published together under a seqlock:
+ * the writer makes seq odd, updates them, then makes seq even again.
+ * Readers retry until they see the same even seq before and after
+ * (for a while: a writer that dies mid-update leaves seq odd).
+ *
+ * hot counts the instructions executed at each address. Only the
+ * machine writes it, one counter at a time, so readers just sample
+ * it (no seqlock).
+ */
+constexpr uint32_t STATUS_MAGIC = 0x5453584d; // "MXST"
+
+enum class RunState : uint32_t { IDLE, RUNNING, HALTED, ERROR, EXITED };
+
+struct MixStatus {
+  uint32_t magic;
+  std::atomic<uint32_t> seq;
+  std::atomic<int32_t> pc;
+  std::atomic<int32_t> ts;
+  std::atomic<uint64_t> retired;
+  std::atomic<uint32_t> state;
+  std::atomic<uint32_t> hot[MEM_SIZE];
+};
+
+// A consistent copy of the seqlocked fields
+struct MixStatusView {
+  int pc;
+  int ts;
+  uint64_t retired;
+  RunState state;
+};
+
+// Where the status goes in the core file (aligned for the atomics),
+// and the size of the whole mapping
+constexpr size_t STATUS_OFF = (sizeof(MixCore) + 63) / 64 * 64;
+constexpr size_t CORE_MAP_SIZE = STATUS_OFF + sizeof(MixStatus);
+
+/*
+ * Initialize the status area at the given address (zeroing the hot
+ * counters), and return it.
+ */
+MixStatus *status_init(void *addr);
+
+/*
+ * Publish (single writer), or read a consistent view of, the
+ * seqlocked fields.
+ * status_read gives up after a bounded number of retries, eg. if the
+ * writer died in the middle of a publish, and returns -1 (view is
+ * left unchanged).
+ */
+void status_publish(MixStatus *st, int pc, int ts, uint64_t retired,
+    RunState state);
+int status_read(const MixStatus *st, MixStatusView& view);
+
+// Bump the hot counter of addr (single writer, no atomic RMW)
+inline void status_hot(MixStatus *st, int addr) {
+  auto &c = st->hot[addr];
+  c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
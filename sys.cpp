@@ -1,6 +1,7 @@
 #include <string>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <string.h>
 #include "sys.h"
@@ -33,6 +34,49 @@ void unmap_and_close(void *map, size_t sz, int fd) {
   close_noerr(fd);
 }
 
+void map_shared_read(std::string filename, size_t sz, void *& map, int& fd) {
+  fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw Sys_error(errno);
+  }
+  // Touching the map past the end of the file would raise SIGBUS
+  off_t end = lseek(fd, 0, SEEK_END);
+  if (end == (off_t) -1 || (size_t) end < sz) {
+    int err = (end == (off_t) -1) ? errno : EINVAL;
+    close_noerr(fd);
+    throw Sys_error(err);
+  }
+  map = mmap(nullptr, sz, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close_noerr(fd);
+    throw Sys_error(errno);
+  }
+}
+
+void *map_private(int fd, size_t off, size_t sz) {
+  void *map = mmap(
+      nullptr, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t) off);
+  if (map == MAP_FAILED)
+    throw Sys_error(errno);
+  return map;
+}
+
+void unmap(void *map, size_t sz) {
+  munmap(map, sz);
+}
+
+size_t page_size() {
+  return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+int open_read(std::string filename) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw Sys_error(errno);
+  }
+  return fd;
+}
+
 int open_and_resize(std::string filename, size_t sz) {
   const char *path = filename.c_str();
   int fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
@@ -54,7 +98,7 @@ int open_append(std::string filename) {
   return fd;
 }
 
-int seek_read(int fd, void *buf, int off, size_t sz) {
+int seek_read(int fd, void *buf, long off, size_t sz) {
   if (off >= 0) {
     if(lseek(fd, (off_t) off, SEEK_SET) == (off_t) -1)
       throw Sys_error(errno);
@@ -65,7 +109,7 @@ int seek_read(int fd, void *buf, int off, size_t sz) {
   return ret;
 }
 
-int seek_write(int fd, void *buf, int off, size_t sz) {
+int seek_write(int fd, void *buf, long off, size_t sz) {
   if (off >= 0) {
     if(lseek(fd, (off_t) off, SEEK_SET) == (off_t) -1)
       throw Sys_error(errno);
@@ -76,6 +120,116 @@ int seek_write(int fd, void *buf, int off, size_t sz) {
   return ret;
 }
 
+long get_offset(int fd) {
+  off_t off = lseek(fd, 0, SEEK_CUR);
+  if (off == (off_t) -1)
+    throw Sys_error(errno);
+  return (long) off;
+}
+
+void set_offset(int fd, long off) {
+  if (lseek(fd, (off_t) off, SEEK_SET) == (off_t) -1)
+    throw Sys_error(errno);
+}
+
+long get_size(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+    throw Sys_error(errno);
+  return (long) st.st_size;
+}
+
+void read_file(std::string filename, std::vector<char>& out) {
+  const char *path = filename.c_str();
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    throw Sys_error(errno);
+  }
+  out.clear();
+  char buf[4096];
+  while (true) {
+    ssize_t ret = read(fd, buf, sizeof(buf));
+    if (ret == -1) {
+      int err = errno;
+      close_noerr(fd);
+      throw Sys_error(err);
+    }
+    if (ret == 0)
+      break;
+    out.insert(out.end(), buf, buf + ret);
+  }
+  close_noerr(fd);
+}
+
+void write_file(std::string filename, const void *buf, size_t sz) {
+  const char *path = filename.c_str();
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    throw Sys_error(errno);
+  }
+  const char *p = (const char *) buf;
+  while (sz > 0) {
+    ssize_t ret = write(fd, p, sz);
+    if (ret == -1) {
+      int err = errno;
+      close_noerr(fd);
+      throw Sys_error(err);
+    }
+    p += ret;
+    sz -= ret;
+  }
+  close_noerr(fd);
+}
+
+void put_u32(std::vector<char>& out, uint32_t v) {
+  out.insert(out.end(), (char *)&v, (char *)&v + sizeof(v));
+}
+
+uint32_t get_u32(const std::vector<char>& in, size_t& i) {
+  uint32_t v = 0;
+  if (i + sizeof(v) <= in.size())
+    memcpy(&v, &in[i], sizeof(v));
+  i += sizeof(v);
+  return v;
+}
+
+void put_u64(std::vector<char>& out, uint64_t v) {
+  out.insert(out.end(), (char *)&v, (char *)&v + sizeof(v));
+}
+
+uint64_t get_u64(const std::vector<char>& in, size_t& i) {
+  uint64_t v = 0;
+  if (i + sizeof(v) <= in.size())
+    memcpy(&v, &in[i], sizeof(v));
+  i += sizeof(v);
+  return v;
+}
+
+void put_varint(std::vector<char>& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((char)((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back((char) v);
+}
+
+int get_varint(const std::vector<char>& in, size_t& i, uint32_t& v) {
+  v = 0;
+  int shift = 0;
+  while (i < in.size()) {
+    if (shift >= 32) {
+      i = in.size();
+      return -1;
+    }
+    unsigned char b = in[i++];
+    v |= ((uint32_t)(b & 0x7f)) << shift;
+    if (!(b & 0x80))
+      break;
+    shift += 7;
+  }
+  return 0;
+}
+
 void close_noerr(int fd) {
   (void) close(fd);
 }
@@ -1,4 +1,6 @@
 #include <string>
+#include <vector>
+#include <cstdint>
 
 /*
  * Open the given filename as a memory mapped file. If the file
@@ -15,6 +17,32 @@ void open_and_map(std::string filename, size_t sz, void *& map, int& fd);
  */
 void unmap_and_close(void *map, size_t sz, int fd);
 
+/*
+ * Map the first sz bytes of an existing file read only, shared with
+ * whoever else maps it (for watching a running machine).
+ * Throw Sys_error on failure (containing errno, EINVAL if the
+ * file is shorter than sz).
+ * Output stored in map and fd, undo with unmap_and_close.
+ */
+void map_shared_read(std::string filename, size_t sz, void *& map, int& fd);
+
+/*
+ * Map sz bytes at offset off (a multiple of page_size()) of the open
+ * file fd, copy-on-write: writes go to private pages, while untouched
+ * pages stay shared with every other mapping of the file.
+ * Throw Sys_error on failure (containing errno).
+ */
+void *map_private(int fd, size_t off, size_t sz);
+void unmap(void *map, size_t sz);
+size_t page_size();
+
+/*
+ * Open the given filename read only.
+ * Throw Sys_error on failure (containing errno).
+ * Return the new file descriptor.
+ */
+int open_read(std::string filename);
+
 /*
  * Open the given filename and set it to the given size.
  * Throw Sys_error on failure (containing errno).
@@ -34,8 +62,46 @@ int open_append(std::string filename);
  * Throw Sys_error on failure (containing errno).
  * Return number of bytes read/written.
  */
-int seek_read(int fd, void *buf, int off, size_t sz);
-int seek_write(int fd, void *buf, int off, size_t sz);
+int seek_read(int fd, void *buf, long off, size_t sz);
+int seek_write(int fd, void *buf, long off, size_t sz);
+
+/*
+ * Get/set the current file offset (where seek_read/seek_write
+ * with off = -1 start).
+ * Throw Sys_error on failure (containing errno).
+ */
+long get_offset(int fd);
+void set_offset(int fd, long off);
+
+/*
+ * Get the size of the open file.
+ * Throw Sys_error on failure (containing errno).
+ */
+long get_size(int fd);
+
+/*
+ * Read the entire contents of the given filename into out,
+ * or replace the contents of the given filename with sz bytes
+ * from buf (creating it if needed).
+ * Throw Sys_error on failure (containing errno).
+ */
+void read_file(std::string filename, std::vector<char>& out);
+void write_file(std::string filename, const void *buf, size_t sz);
+
+/*
+ * Append/consume little binary fields in a byte buffer, for the
+ * compact on-disk formats (tape images, I/O logs).
+ * uint32/uint64 fields are native byte order, varints are LEB128.
+ * get_* advance i, and read zeros past the end of the buffer.
+ * get_varint returns -1 (and moves i to the end of the buffer) if the
+ * varint runs past 5 bytes, which only a corrupt buffer has.
+ */
+void put_u32(std::vector<char>& out, uint32_t v);
+uint32_t get_u32(const std::vector<char>& in, size_t& i);
+void put_u64(std::vector<char>& out, uint64_t v);
+uint64_t get_u64(const std::vector<char>& in, size_t& i);
+void put_varint(std::vector<char>& out, uint32_t v);
+int get_varint(const std::vector<char>& in, size_t& i, uint32_t& v);
 
 /*
  * Close without error handling
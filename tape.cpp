@@ -0,0 +1,200 @@
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <string.h>
+#include "dbg.h"
+#include "sys.h"
+#include "tape.h"
+
+const char TAPE_MAGIC[] = "MIXTAPE1";
+constexpr size_t TAPE_MAGIC_SIZE = 8;
+
+void rle_encode(const void *src, size_t sz, std::vector<char>& out) {
+  const uint32_t *w = (const uint32_t *) src;
+  size_t n = sz / sizeof(uint32_t);
+  out.clear();
+  size_t i = 0;
+  while (i < n) {
+    // Measure the run starting at i
+    size_t j = i + 1;
+    while (j < n && w[j] == w[i])
+      j++;
+    if (j - i >= 2) {
+      put_varint(out, (uint32_t)(2 * (j - i)));
+      put_u32(out, w[i]);
+      i = j;
+      continue;
+    }
+    // Literal stretch: runs until the next pair of equal words
+    j = i + 1;
+    while (j < n && !(j + 1 < n && w[j] == w[j+1]))
+      j++;
+    put_varint(out, (uint32_t)(2 * (j - i) + 1));
+    out.insert(out.end(), (const char *)&w[i], (const char *)&w[j]);
+    i = j;
+  }
+}
+
+void rle_decode(const std::vector<char>& in, void *dest, size_t sz) {
+  uint32_t *w = (uint32_t *) dest;
+  size_t n = sz / sizeof(uint32_t);
+  size_t i = 0, k = 0;
+  while (i < in.size() && k < n) {
+    uint32_t hdr;
+    if (get_varint(in, i, hdr) < 0) {
+      LOG_WARN(io, "Corrupt run header in tape block at ", k);
+      break;
+    }
+    size_t ct = hdr / 2;
+    if (ct > n - k)
+      ct = n - k;
+    if (hdr % 2 == 0) {
+      uint32_t v = get_u32(in, i);
+      for (size_t c = 0; c < ct; c++)
+        w[k++] = v;
+    } else {
+      for (size_t c = 0; c < ct; c++)
+        w[k++] = get_u32(in, i);
+    }
+  }
+  // Truncated/short block, rest is zeros
+  zero_out(&w[k], (n - k) * sizeof(uint32_t));
+}
+
+MixTape::MixTape(size_t block_bytes, size_t num_blocks)
+  : block_bytes(block_bytes), num_blocks(num_blocks),
+    blocks(num_blocks) {}
+
+void MixTape::load(std::string filename) {
+  LOG_INFO(io, "Loading compressed tape image ", filename);
+  std::vector<char> raw;
+  try {
+    read_file(filename, raw);
+  } catch (Sys_error &e) {
+    if (e.err != ENOENT)
+      throw;
+    raw.clear();
+  }
+
+  if (raw.size() < TAPE_MAGIC_SIZE ||
+      memcmp(&raw[0], TAPE_MAGIC, TAPE_MAGIC_SIZE) != 0) {
+    // Dense image (or empty): compress block by block
+    LOG_DEBUG(io, "No tape header, reading dense image of size ", raw.size());
+    for (auto &b : blocks)
+      b.clear();
+    raw.resize(block_bytes * num_blocks);
+    std::vector<char> zeros(block_bytes);
+    for (size_t b = 0; b < num_blocks; b++) {
+      const char *p = &raw[b * block_bytes];
+      if (memcmp(p, zeros.data(), block_bytes) != 0)
+        rle_encode(p, block_bytes, blocks[b]);
+    }
+  } else if (decode(raw) < 0) {
+    throw Sys_error(EINVAL);
+  }
+  dirty = false;
+}
+
+int MixTape::decode(const std::vector<char>& raw) {
+  if (raw.size() < TAPE_MAGIC_SIZE ||
+      memcmp(&raw[0], TAPE_MAGIC, TAPE_MAGIC_SIZE) != 0) {
+    LOG_WARN(io, "Not a compressed tape image");
+    return -1;
+  }
+  size_t i = TAPE_MAGIC_SIZE;
+  uint32_t file_block_bytes = get_u32(raw, i);
+  uint32_t file_num_blocks = get_u32(raw, i);
+  uint32_t ct = get_u32(raw, i);
+  if (file_block_bytes != block_bytes || file_num_blocks != num_blocks) {
+    LOG_WARN(io, "Tape image has mismatched geometry ",
+        file_block_bytes, file_num_blocks);
+    return -1;
+  }
+  std::vector<std::vector<char>> image(num_blocks);
+  for (uint32_t c = 0; c < ct && i < raw.size(); c++) {
+    uint32_t b = get_u32(raw, i);
+    uint32_t len = get_u32(raw, i);
+    if (b >= num_blocks || i + len > raw.size()) {
+      LOG_WARN(io, "Corrupt block in tape image at block ", b);
+      return -1;
+    }
+    image[b].assign(raw.begin() + i, raw.begin() + i + len);
+    i += len;
+  }
+  blocks.swap(image);
+  dirty = true;
+  return 0;
+}
+
+void MixTape::save(std::string filename) {
+  LOG_INFO(io, "Saving compressed tape image ", filename);
+  std::vector<char> raw;
+  encode(raw);
+  write_file(filename, raw.data(), raw.size());
+  dirty = false;
+}
+
+void MixTape::encode(std::vector<char>& out) {
+  out.insert(out.end(), TAPE_MAGIC, TAPE_MAGIC + TAPE_MAGIC_SIZE);
+  uint32_t ct = 0;
+  for (auto &b : blocks)
+    ct += !b.empty();
+  put_u32(out, (uint32_t) block_bytes);
+  put_u32(out, (uint32_t) num_blocks);
+  put_u32(out, ct);
+  for (size_t b = 0; b < num_blocks; b++) {
+    if (blocks[b].empty())
+      continue;
+    put_u32(out, (uint32_t) b);
+    put_u32(out, (uint32_t) blocks[b].size());
+    out.insert(out.end(), blocks[b].begin(), blocks[b].end());
+  }
+}
+
+void MixTape::read(void *dest, size_t off, size_t sz) {
+  std::vector<char> buf(block_bytes);
+  char *out = (char *) dest;
+  while (sz > 0) {
+    size_t b = off / block_bytes;
+    size_t boff = off % block_bytes;
+    size_t ct = block_bytes - boff;
+    if (ct > sz)
+      ct = sz;
+    if (b >= num_blocks || blocks[b].empty()) {
+      zero_out(out, ct);
+    } else {
+      rle_decode(blocks[b], buf.data(), block_bytes);
+      memcpy(out, &buf[boff], ct);
+    }
+    out += ct;
+    off += ct;
+    sz -= ct;
+  }
+}
+
+void MixTape::write(const void *src, size_t off, size_t sz) {
+  std::vector<char> buf(block_bytes);
+  std::vector<char> zeros(block_bytes);
+  const char *in = (const char *) src;
+  while (sz > 0) {
+    size_t b = off / block_bytes;
+    size_t boff = off % block_bytes;
+    size_t ct = block_bytes - boff;
+    if (ct > sz)
+      ct = sz;
+    if (b < num_blocks) {
+      // Partial block writes need the old contents
+      if (ct < block_bytes)
+        read(buf.data(), b * block_bytes, block_bytes);
+      memcpy(&buf[boff], in, ct);
+      if (memcmp(buf.data(), zeros.data(), block_bytes) == 0)
+        blocks[b].clear();
+      else
+        rle_encode(buf.data(), block_bytes, blocks[b]);
+      dirty = true;
+    }
+    in += ct;
+    off += ct;
+    sz -= ct;
+  }
+}
@@ -0,0 +1,70 @@
+#include <string>
+#include <vector>
+
+/*
+ * Compressed magnetic tape image.
+ *
+ * Blocks are kept in memory in run-length encoded form, decoded
+ * on each read and re-encoded on each write. Blocks that are
+ * entirely zero are not stored at all. The whole image is loaded
+ * from (and saved to) a single host file.
+ *
+ * File format (native byte order, like core dumps):
+ *   "MIXTAPE1"                          8 byte magic
+ *   block_bytes, num_blocks, ct          uint32 each
+ *   ct times:
+ *     block number, encoded length       uint32 each
+ *     encoded block                      (see below)
+ *
+ * Encoded block: the block is treated as 4 byte units (independent
+ * of the in-memory Word size), encoded as a sequence of runs, each
+ * starting with a varint header n. If n is even, it's followed by a
+ * single unit repeated n/2 times. If n is odd, it's followed by
+ * (n-1)/2 literal units.
+ *
+ * Throw Sys_error on failure (containing errno).
+ */
+class MixTape {
+public:
+  MixTape(size_t block_bytes, size_t num_blocks);
+  /*
+   * Replace the image with the given file. Files without the magic
+   * header are read as a dense (uncompressed) tape image.
+   * A missing file is an empty tape.
+   */
+  void load(std::string filename);
+  /*
+   * Write the compressed image to the given file.
+   */
+  void save(std::string filename);
+  /*
+   * Append the image to out, in the file format above, or replace
+   * the image with the one in raw (which then counts as written).
+   * decode returns -1, leaving the image unchanged, if raw isn't a
+   * valid image of this geometry.
+   */
+  void encode(std::vector<char>& out);
+  int decode(const std::vector<char>& raw);
+  /*
+   * Read/write sz bytes at byte offset off into the tape.
+   * Bytes past the end of the tape read as zero (and are dropped
+   * when written).
+   */
+  void read(void *dest, size_t off, size_t sz);
+  void write(const void *src, size_t off, size_t sz);
+  // true if written since the last load/save
+  bool is_dirty() { return dirty; }
+private:
+  size_t block_bytes;
+  size_t num_blocks;
+  // encoded blocks (empty = all zeros)
+  std::vector<std::vector<char>> blocks;
+  bool dirty = false;
+};
+
+/*
+ * Run-length encode/decode a block of 4 byte units (see above).
+ * sz must be a multiple of 4.
+ */
+void rle_encode(const void *src, size_t sz, std::vector<char>& out);
+void rle_decode(const std::vector<char>& in, void *dest, size_t sz);
@@ -0,0 +1,166 @@
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <poll.h>
+#include <unistd.h>
+#include "dbg.h"
+#include "ring.h"
+#include "term.h"
+
+constexpr size_t CONSOLE_RING_SIZE = 1 << 16;
+// How long the helper waits for stdin before checking for output
+// (and for stop()) again
+constexpr int CONSOLE_POLL_MS = 10;
+
+struct MixConsole::Rings {
+  SpscRing<char, CONSOLE_RING_SIZE> in;
+  SpscRing<char, CONSOLE_RING_SIZE> out;
+};
+
+MixConsole::MixConsole() {
+  rings = new Rings();
+}
+
+MixConsole::~MixConsole() {
+  stop();
+  delete rings;
+}
+
+void MixConsole::start() {
+  if (running)
+    return;
+  LOG_INFO(io, "Starting console helper thread");
+  // Anything the REPL already buffered from stdin belongs
+  // to the terminal now (except the end of the REPL's own line).
+  std::streamsize avail = std::cin.rdbuf()->in_avail();
+  while (avail > 0 && (std::cin.rdbuf()->sgetc() == ' ' ||
+        std::cin.rdbuf()->sgetc() == '\t')) {
+    std::cin.rdbuf()->sbumpc();
+    avail--;
+  }
+  if (avail > 0 && std::cin.rdbuf()->sgetc() == '\n') {
+    std::cin.rdbuf()->sbumpc();
+    avail--;
+  }
+  while (avail-- > 0) {
+    char c = std::cin.rdbuf()->sbumpc();
+    if (!rings->in.push(c))
+      break;
+  }
+  std::cout.flush();
+  running = true;
+  helper = std::thread(&MixConsole::service, this);
+}
+
+void MixConsole::stop() {
+  if (!running)
+    return;
+  LOG_INFO(io, "Stopping console helper thread");
+  running = false;
+  helper.join();
+}
+
+bool MixConsole::read_line(std::string& line) {
+  char c;
+  while (rings->in.pop(c)) {
+    if (c == '\n') {
+      line = pending;
+      pending.clear();
+      return true;
+    }
+    pending.push_back(c);
+  }
+  return false;
+}
+
+void MixConsole::wait_input(int us) {
+  std::unique_lock<std::mutex> lk {input_lock};
+  input_ready.wait_for(lk, std::chrono::microseconds(us),
+      [this] { return !rings->in.empty() || !running; });
+}
+
+void MixConsole::write(const char *buf, size_t sz) {
+  for (size_t i = 0; i < sz; i++) {
+    while (!rings->out.push(buf[i])) {
+      // Nobody will drain the ring if the helper isn't running
+      if (!running)
+        return;
+      std::this_thread::yield();
+    }
+  }
+}
+
+std::string MixConsole::get_input() {
+  // Put it all back in the backlog, in order, for start() to feed
+  // to the ring again
+  std::string input = pending;
+  pending.clear();
+  char c;
+  while (rings->in.pop(c))
+    input.push_back(c);
+  backlog.insert(0, input);
+  return backlog;
+}
+
+void MixConsole::set_input(const std::string& input) {
+  pending.clear();
+  char c;
+  while (rings->in.pop(c))
+    ;
+  backlog = input;
+}
+
+void MixConsole::service() {
+  char buf[4096];
+  while (true) {
+    // Flush output
+    size_t n = 0;
+    while (n < sizeof(buf) && rings->out.pop(buf[n]))
+      n++;
+    if (n > 0) {
+      size_t done = 0;
+      while (done < n) {
+        ssize_t ret = ::write(STDOUT_FILENO, buf + done, n - done);
+        if (ret <= 0)
+          break;
+        done += ret;
+      }
+      continue;
+    }
+    if (!running)
+      break;
+
+    // Move any backlog into the input ring
+    size_t k = 0;
+    while (k < backlog.size() && rings->in.push(backlog[k]))
+      k++;
+    backlog.erase(0, k);
+    if (k > 0) {
+      // Under the lock, so wait_input can't miss it between its
+      // check and going to sleep
+      std::lock_guard<std::mutex> lk {input_lock};
+      input_ready.notify_one();
+    }
+
+    // Wait for input (or timeout)
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    if (!backlog.empty() || poll(&pfd, 1, CONSOLE_POLL_MS) <= 0) {
+      if (!backlog.empty())
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(CONSOLE_POLL_MS));
+      continue;
+    }
+    ssize_t ret = ::read(STDIN_FILENO, buf, sizeof(buf));
+    if (ret <= 0) {
+      // EOF/error: nothing more will arrive, just keep flushing
+      std::this_thread::sleep_for(
+          std::chrono::milliseconds(CONSOLE_POLL_MS));
+      continue;
+    }
+    backlog.append(buf, ret);
+  }
+}
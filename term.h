@@ -0,0 +1,64 @@
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+/*
+ * Bridge between the MIX terminal (unit 19) and the process's
+ * stdin/stdout.
+ *
+ * A helper thread moves bytes between the host file descriptors and
+ * two lock-free rings, so the emulator itself never blocks on host
+ * I/O: read_line() only returns lines that have fully arrived, and
+ * write() only queues output for the helper to flush.
+ *
+ * The helper only runs between start() and stop(), so stdin stays
+ * available to the REPL the rest of the time. Input that has been
+ * read but not consumed is kept for the next start().
+ */
+class MixConsole {
+public:
+  MixConsole();
+  ~MixConsole();
+  void start();
+  void stop();
+  /*
+   * Fetch the next complete input line (without its newline).
+   * Return false (without blocking) if there isn't one yet.
+   */
+  bool read_line(std::string& line);
+  /*
+   * Wait up to us microseconds for more input to arrive (return
+   * right away if some is already waiting to be read).
+   */
+  void wait_input(int us);
+  /*
+   * Queue sz bytes of output. Only waits if the output ring is full.
+   */
+  void write(const char *buf, size_t sz);
+  /*
+   * Checkpoint support, only while stopped: get the input that has
+   * arrived but hasn't been read yet (including a partial line), or
+   * replace it.
+   */
+  std::string get_input();
+  void set_input(const std::string& input);
+private:
+  struct Rings;
+  // byte rings (owned):
+  //   in: helper -> emulator
+  //   out: emulator -> helper
+  Rings *rings;
+  // partial line consumed from the input ring so far
+  std::string pending;
+  // bytes read from stdin that didn't fit in the input ring yet
+  // (helper only, kept across stop() and start())
+  std::string backlog;
+  // wait_input sleeps on this, the helper signals it on new input
+  std::mutex input_lock;
+  std::condition_variable input_ready;
+  std::thread helper;
+  std::atomic<bool> running {false};
+  void service();
+};
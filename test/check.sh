@@ -0,0 +1,114 @@
+#!/bin/sh
+# Regression checks, run by "make check" from the top of the tree.
+# Each check runs in its own scratch directory (with dev/ and out/).
+top=$(pwd)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+fail() {
+  echo "FAIL: $*"
+  failed=1
+}
+
+scratch() {
+  dir=$(mktemp -d -p "$tmp")
+  mkdir "$dir/dev" "$dir/out"
+  cd "$dir" || exit 1
+}
+
+# Waiting on a busy tape must not move the clock backwards
+check_io_wait() {
+  scratch
+  "$top/mix" run "$top/test/io_wait.mix" --stats > stats.txt
+  grep -q "^mix time 3006 u" stats.txt || fail "io_wait: $(head -3 stats.txt)"
+}
+
+# A run split by a checkpoint (with the tape busy) must end the same,
+# in a new process
+check_checkpoint() {
+  scratch
+  printf "load $top/test/io_wait.mix\nstep 3\ncheckpoint c.ckpt\n" |
+    "$top/mix" > /dev/null
+  printf "restore c.ckpt\nrun\nregisters\n" | "$top/mix" > regs.txt
+  grep -q "TS: 3006" regs.txt || fail "checkpoint: $(grep TS regs.txt)"
+}
+
+# A checkpoint with the pc out of memory isn't restored
+check_checkpoint_pc() {
+  scratch
+  printf "load $top/test/io_wait.mix\nstep 3\ncheckpoint c.ckpt\n" |
+    "$top/mix" > /dev/null
+  # pc follows the magic, version, sizeof(MixCore) and the core
+  at=$((16 + $(od -An -tu4 -j12 -N4 c.ckpt)))
+  # 50000000, little endian
+  printf '\200\360\372\002' |
+    dd of=c.ckpt bs=1 seek=$at conv=notrunc 2> /dev/null
+  printf "restore c.ckpt\nstep\nregisters\n" | "$top/mix" > regs.txt
+  [ $? = 0 ] || fail "checkpoint_pc: mix crashed"
+  grep -q "Failed to restore" regs.txt ||
+    fail "checkpoint_pc: restored a pc out of memory"
+}
+
+# An OUT to a disk with X out of range (at the OUT, or changed before
+# the transfer runs) is an error, and leaves the disk alone
+check_disk_x() {
+  for prog in disk_x disk_x_late; do
+    scratch
+    "$top/mix" run "$top/test/$prog.mix" 2> err.txt
+    [ $? = 1 ] || fail "$prog: didn't stop with an error"
+    [ ! -e dev/d0 ] || [ "$(wc -c < dev/d0)" = 50000 ] ||
+      fail "$prog: disk grew to $(wc -c < dev/d0) bytes"
+  done
+}
+
+# CPUs synchronized with XCHA must end the same whether they run in
+# clock order or on separate threads
+check_multi() {
+  scratch
+  "$top/mixmp" "$top/test/lock.mix" 4 1000000 serial.mix > serial.txt ||
+    fail "multi: serial run didn't halt"
+  "$top/mixmp" "$top/test/lock.mix" 4 1000000 parallel.mix 100 \
+    > parallel.txt || fail "multi: parallel run didn't halt"
+  cmp -s serial.mix parallel.mix || fail "multi: cores differ"
+  [ "$(grep -c halted parallel.txt)" = 4 ] ||
+    fail "multi: not every CPU halted"
+}
+
+# A core file that can't be created is an error, not a crash
+check_run_errors() {
+  scratch
+  "$top/mix" run "$top/test/io_wait.mix" --core "$dir/none/core" \
+    2> err.txt
+  [ $? = 1 ] || fail "run: missing core directory, $(cat err.txt)"
+}
+
+# The embedding API (see test/libmix_test.cpp)
+check_libmix() {
+  "$top/test/libmix_test" || fail "libmix"
+}
+
+# Lanes run in lockstep must end as the same program run alone
+check_sweep() {
+  scratch
+  "$top/mixsweep" "$top/test/sweep.mix" 10000 out \
+    "$top"/test/sweep/*.mix > sweep.txt || fail "sweep: mixsweep failed"
+  k=0
+  for data in "$top"/test/sweep/*.mix; do
+    cat "$top/test/sweep.mix" "$data" > prog.mix
+    "$top/mix" run prog.mix --dump alone.mix > /dev/null
+    cmp -s alone.mix "out/lane$k.mix" || fail "sweep: lane $k ($data)"
+    k=$((k + 1))
+  done
+}
+
+check_io_wait
+check_checkpoint
+check_checkpoint_pc
+check_disk_x
+check_multi
+check_sweep
+check_libmix
+check_run_errors
+[ $failed = 0 ] && echo "All checks passed"
+exit $failed
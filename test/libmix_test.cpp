@@ -0,0 +1,80 @@
+#include <iostream>
+#include <string>
+#include "libmix.h"
+
+/*
+ * Checks of the embedding API (libmix.h), run by test/check.sh.
+ * Exit code: 0 if they all pass.
+ */
+
+static int failed = 0;
+
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    std::cout << "FAIL: libmix_test.cpp:" << __LINE__ << ": " #cond \
+      << std::endl; \
+    failed = 1; \
+  } \
+} while (0)
+
+// An IN whose block runs past the end of memory fails the machine,
+// without calling the handler or writing memory
+static void check_in_bounds() {
+  MixMachine m;
+  m.load("0000: + 62 22 00 16 36\n"  // IN 3990(16)
+      "0001: + 00 01 00 16 34\n"     // JBUS *(16)
+      "0002: + 00 00 00 02 05\n");   // HLT
+  int calls = 0;
+  m.set_device(16, [&calls](int, int *words, int n) {
+    calls++;
+    for (int k = 0; k < n; k++)
+      words[k] = 7;
+    return 0;
+  });
+  CHECK(m.run(1000) == MixMachine::Stop::ERROR);
+  CHECK(calls == 0);
+  int v = -1;
+  CHECK(m.get_mem(3999, v) == 0 && v == 0);
+}
+
+// Writing a tape past its last block fails, instead of growing it
+static void check_tape_end() {
+  MixMachine m;
+  m.load("0000: + 15 39 00 00 35\n"  // IOC 999(0)
+      "0001: + 00 00 00 00 37\n"     // OUT 0(0)
+      "0002: + 00 00 00 00 37\n"     // OUT 0(0)
+      "0003: + 00 03 00 00 34\n"     // JBUS *(0)
+      "0004: + 00 00 00 02 05\n");   // HLT
+  CHECK(m.run(1000) == MixMachine::Stop::ERROR);
+  CHECK(m.get_pc() == 3);
+}
+
+// Lines that aren't words or registers are skipped
+static void check_load_junk() {
+  MixMachine m;
+  m.load("0000: + 0 0 0 2 5\nhello world\nI\nTS: 12\n");
+  int v = 0;
+  CHECK(m.get_mem(0, v) == 0 && v == 2 * 64 + 5);
+  CHECK(m.run(10) == MixMachine::Stop::HALT);
+}
+
+// interrupt() stops a run that would otherwise wait forever
+static void check_interrupt() {
+  MixMachine m;
+  m.load("0000: + 00 00 00 16 36\n"  // IN 0(16)
+      "0001: + 00 01 00 16 34\n"     // JBUS *(16)
+      "0002: + 00 00 00 02 05\n");   // HLT
+  m.set_device(16, [&m](int, int *, int) {
+    m.interrupt();
+    return 1;
+  });
+  CHECK(m.run() == MixMachine::Stop::INTERRUPT);
+}
+
+int main() {
+  check_in_bounds();
+  check_tape_end();
+  check_load_junk();
+  check_interrupt();
+  return failed;
+}
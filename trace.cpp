@@ -0,0 +1,191 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cerrno>
+#include <cstdint>
+#include <string.h>
+#include "dbg.h"
+#include "sys.h"
+#include "core.h"
+#include "ring.h"
+#include "trace.h"
+
+const char TRACE_MAGIC[] = "MIXTRACE";
+constexpr size_t TRACE_MAGIC_SIZE = 8;
+// Write encoded records to the file once this much is pending
+constexpr size_t TRACE_FLUSH_SIZE = 1 << 16;
+
+constexpr int FLAG_PC = 1;
+constexpr int FLAG_INST = 2;
+constexpr int FLAG_ADDR = 4;
+
+static void put_svarint(std::vector<char>& out, int v) {
+  put_varint(out, ((uint32_t) v << 1) ^ (uint32_t)(v >> 31));
+}
+
+static int get_svarint(const std::vector<char>& in, size_t& i) {
+  uint32_t v;
+  // A corrupt varint fails the whole record (see decode)
+  if (get_varint(in, i, v) < 0)
+    i = in.size() + 1;
+  return (int) (v >> 1) ^ -(int) (v & 1);
+}
+
+TraceCodec::TraceCodec() : insts(MEM_SIZE), known(MEM_SIZE, false) {}
+
+void TraceCodec::encode(const TraceRec& r, std::vector<char>& out) {
+  int flags = 0;
+  if (r.pc != pc + 1)
+    flags |= FLAG_PC;
+  if (!known[r.pc] || insts[r.pc] != r.inst)
+    flags |= FLAG_INST;
+  if (r.addr >= 0)
+    flags |= FLAG_ADDR;
+  flags |= (r.dest + 1) << 4;
+  out.push_back((char) flags);
+  if (flags & FLAG_PC)
+    put_svarint(out, r.pc - pc);
+  if (flags & FLAG_INST) {
+    const char *w = (const char *) &r.inst;
+    out.insert(out.end(), w, w + sizeof(Word));
+    insts[r.pc] = r.inst;
+    known[r.pc] = true;
+  }
+  if (flags & FLAG_ADDR) {
+    put_svarint(out, r.addr - addr);
+    addr = r.addr;
+  }
+  if (r.dest != TRACE_NONE) {
+    put_svarint(out, r.value - values[r.dest]);
+    values[r.dest] = r.value;
+  }
+  put_svarint(out, r.ts - ts);
+  pc = r.pc;
+  ts = r.ts;
+}
+
+bool TraceCodec::decode(const std::vector<char>& in, size_t& i,
+    TraceRec& r) {
+  if (i >= in.size())
+    return false;
+  int flags = (unsigned char) in[i++];
+  r.pc = (flags & FLAG_PC) ? pc + get_svarint(in, i) : pc + 1;
+  if (r.pc < 0 || r.pc >= MEM_SIZE)
+    return false;
+  if (flags & FLAG_INST) {
+    if (i + sizeof(Word) > in.size())
+      return false;
+    memcpy(&insts[r.pc], &in[i], sizeof(Word));
+    known[r.pc] = true;
+    i += sizeof(Word);
+  }
+  r.inst = insts[r.pc];
+  r.addr = -1;
+  if (flags & FLAG_ADDR) {
+    addr += get_svarint(in, i);
+    r.addr = addr;
+  }
+  r.dest = (flags >> 4) - 1;
+  if (r.dest > TRACE_MEM)
+    return false;
+  if (r.dest != TRACE_NONE) {
+    values[r.dest] += get_svarint(in, i);
+    r.value = values[r.dest];
+  }
+  ts += get_svarint(in, i);
+  r.ts = ts;
+  pc = r.pc;
+  // (get_varint reads zeros past the end, get_svarint fails past it)
+  return i <= in.size();
+}
+
+bool trace_check_header(const std::vector<char>& in, size_t& i) {
+  if (in.size() < i + TRACE_MAGIC_SIZE + 4 ||
+      memcmp(&in[i], TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0)
+    return false;
+  i += TRACE_MAGIC_SIZE;
+  return get_u32(in, i) == TRACE_VERSION;
+}
+
+static void open_trace(std::ofstream& out, std::string filename) {
+  out.open(filename, std::ios::binary | std::ios::trunc);
+  if (!out)
+    throw Sys_error(errno);
+  std::vector<char> header(TRACE_MAGIC, TRACE_MAGIC + TRACE_MAGIC_SIZE);
+  put_u32(header, TRACE_VERSION);
+  out.write(header.data(), header.size());
+}
+
+MixTracer::MixTracer(std::string filename) : filename(filename) {
+  LOG_INFO(mix, "Tracing to ", filename);
+  open_trace(out, filename);
+  consumer = std::thread(&MixTracer::consume, this);
+}
+
+MixTracer::MixTracer(std::string filename, size_t n)
+  : filename(filename), flight(n) {
+  LOG_INFO(mix, "Flight recording the last n instructions, to ", n, filename);
+  kept.reserve(n);
+}
+
+MixTracer::~MixTracer() {
+  if (consumer.joinable()) {
+    done = true;
+    consumer.join();
+  }
+}
+
+void MixTracer::record(const TraceRec& r) {
+  if (flight > 0) {
+    if (kept.size() < flight) {
+      kept.push_back(r);
+    } else {
+      kept[next] = r;
+      next = (next + 1) % flight;
+    }
+    return;
+  }
+  while (!ring.push(r))
+    std::this_thread::yield();
+}
+
+void MixTracer::consume() {
+  std::vector<char> buf;
+  TraceRec r;
+  while (true) {
+    // Check before draining, so nothing pushed before done is lost
+    bool stopping = done.load();
+    while (ring.pop(r)) {
+      codec.encode(r, buf);
+      if (buf.size() >= TRACE_FLUSH_SIZE) {
+        out.write(buf.data(), buf.size());
+        buf.clear();
+      }
+    }
+    if (stopping)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  out.write(buf.data(), buf.size());
+  out.close();
+}
+
+void MixTracer::dump() {
+  LOG_INFO(mix, "Dumping the flight recorder, n = ", kept.size(), filename);
+  std::ofstream fs;
+  open_trace(fs, filename);
+  TraceCodec fresh;
+  std::vector<char> buf;
+  size_t n = kept.size();
+  for (size_t k = 0; k < n; k++) {
+    // Oldest first
+    fresh.encode(kept[(next + k) % n], buf);
+  }
+  fs.write(buf.data(), buf.size());
+  fs.close();
+  if (!fs)
+    throw Sys_error(errno);
+}
@@ -0,0 +1,116 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+
+/*
+ * One executed instruction, as recorded by MixCPU::tick:
+ *   ts     clock ts it completed at
+ *   pc     its address
+ *   inst   the instruction word
+ *   addr   M (the address field after indexing), -1 if it isn't
+ *          a valid memory address
+ *   dest   what it changed: a register (0 to NUM_REGS-1, see
+ *          core_reg), TRACE_MEM for memory at addr, or TRACE_NONE
+ *   value  the new value of dest
+ * Only the main destination is recorded (eg. A, not X, for MUL;
+ * J for taken jumps; nothing for MOVE or compares).
+ */
+constexpr int TRACE_NONE = -1;
+constexpr int TRACE_MEM = 9;
+
+struct TraceRec {
+  int ts;
+  int pc;
+  Word inst;
+  int addr;
+  int dest;
+  int value;
+};
+
+/*
+ * Binary trace file format:
+ *   "MIXTRACE"                          8 byte magic
+ *   version                             uint32
+ * then one record per instruction, delta encoded against the
+ * previous ones (varints are LEB128, signed ones zigzag encoded):
+ *   flags                               1 byte
+ *     bit 0: pc isn't the previous pc + 1, signed varint delta follows
+ *     bit 1: inst differs from the last one recorded at pc, raw Word
+ *            follows (so loops don't repeat their instructions)
+ *     bit 2: addr follows, signed varint delta from the previous addr
+ *     bits 4-7: dest + 1 (0 = none), if set the value follows as a
+ *            signed varint delta from the last value of that dest
+ *   ts                                  signed varint delta
+ * So an instruction in a loop takes 3 to 6 bytes.
+ */
+constexpr uint32_t TRACE_VERSION = 1;
+
+class TraceCodec {
+public:
+  TraceCodec();
+  // Append the encoding of r to out
+  void encode(const TraceRec& r, std::vector<char>& out);
+  /*
+   * Decode the record at in[i] (advancing i) into r.
+   * Return false if in is truncated there.
+   */
+  bool decode(const std::vector<char>& in, size_t& i, TraceRec& r);
+private:
+  // Everything the encoding is relative to, mirrored by the decoder
+  int pc = -1;
+  int ts = 0;
+  int addr = 0;
+  int values[TRACE_MEM + 1] = {};
+  // last instruction recorded at each address (if known)
+  std::vector<Word> insts;
+  std::vector<bool> known;
+};
+
+/*
+ * Check the trace header at in[i] (advancing i past it).
+ */
+bool trace_check_header(const std::vector<char>& in, size_t& i);
+
+/*
+ * Records the instructions a CPU executes (see MixCPU::set_tracer).
+ *
+ * Streaming: records go through a lock-free ring (see ring.h) to a
+ * consumer thread, which encodes them and writes them to the file.
+ * The CPU only waits if the ring is full.
+ *
+ * Flight recorder: only the last n records are kept, in memory, and
+ * written out by dump() (Mix does it when the machine fails).
+ *
+ * Throw Sys_error if the file can't be created.
+ */
+class MixTracer {
+public:
+  MixTracer(std::string filename);
+  MixTracer(std::string filename, size_t n);
+  // Writes out everything recorded (streaming), or nothing (flight)
+  ~MixTracer();
+  MixTracer(const MixTracer&) = delete;
+  MixTracer& operator=(const MixTracer&) = delete;
+  void record(const TraceRec& r);
+  bool is_flight() { return flight > 0; }
+  // Flight recorder: write the records kept to the file
+  // (replacing it). Throw Sys_error on failure.
+  void dump();
+private:
+  std::string filename;
+  // flight recorder: the last records, kept[next] is the oldest
+  // once full
+  size_t flight = 0;
+  std::vector<TraceRec> kept;
+  size_t next = 0;
+  // streaming: only the consumer thread touches codec and out
+  SpscRing<TraceRec, 1 << 14> ring;
+  std::atomic<bool> done {false};
+  TraceCodec codec;
+  std::ofstream out;
+  std::thread consumer;
+  void consume();
+};